@@ -0,0 +1,311 @@
+#include "../src/hashmap.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef HAVE_ABSL
+#include <absl/container/flat_hash_map.h>
+#endif
+
+// Compares HashMap with std::unordered_map (and absl::flat_hash_map when it is available) on the common operations.
+// Arguments are the element count, from L1-resident to RAM-bound, and the maximum load factor in percent. Run with --benchmark_filter to pick maps, key kinds or operations.
+
+using Value = std::uint64_t;
+
+template<class K>
+using Coalesced = HashMap<K, Value>;
+
+template<class K>
+using CoalescedSplit = HashMap<K, Value, std::hash<K>, SplitLayout, std::uint32_t, FastRangeIndexer,
+        StoredHash<std::uint32_t>>;
+
+// keyed hashing, which also keeps the adversarial key kinds from building long chains
+template<class K>
+using CoalescedSeeded = HashMap<K, Value, SeededHash<K>>;
+
+template<class K>
+using StdUnordered = std::unordered_map<K, Value>;
+
+#ifdef HAVE_ABSL
+template<class K>
+using AbslFlat = absl::flat_hash_map<K, Value>;
+#endif
+
+// Key kinds: make(n, seed) returns n distinct keys, and seeds below 4 give disjoint sets. Random integer keys are
+// the images of distinct inputs under the bijective MurmurHash3 finalizers.
+struct IntKeys {
+    using type = std::uint32_t;
+
+    static std::vector<type> make(std::size_t n, std::uint64_t seed) {
+        std::vector<type> keys(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            type key = static_cast<type>(i * 4 + seed);
+            key ^= key >> 16;
+            key *= 0x85ebca6bU;
+            key ^= key >> 13;
+            key *= 0xc2b2ae35U;
+            key ^= key >> 16;
+            keys[i] = key;
+        }
+        return keys;
+    }
+};
+
+struct Int64Keys {
+    using type = std::uint64_t;
+
+    static std::vector<type> make(std::size_t n, std::uint64_t seed) {
+        std::vector<type> keys(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            type key = i * 4 + seed;
+            key ^= key >> 33;
+            key *= 0xff51afd7ed558ccdULL;
+            key ^= key >> 33;
+            key *= 0xc4ceb9fe1a85ec53ULL;
+            key ^= key >> 33;
+            keys[i] = key;
+        }
+        return keys;
+    }
+};
+
+struct StringKeys {
+    using type = std::string;
+
+    static std::vector<type> make(std::size_t n, std::uint64_t seed) {
+        std::mt19937_64 random(seed);
+        std::vector<type> keys(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            // a random prefix of 8 to 24 characters, then the index and seed to keep keys distinct
+            std::string key(8 + random() % 17, ' ');
+            for (char &c : key) {
+                c = static_cast<char>('a' + random() % 26);
+            }
+            keys[i] = key + std::to_string(i) + '#' + std::to_string(seed);
+        }
+        return keys;
+    }
+};
+
+// adversarial: consecutive integers, which std::hash maps to themselves
+struct SequentialKeys {
+    using type = std::uint64_t;
+
+    static std::vector<type> make(std::size_t n, std::uint64_t seed) {
+        std::vector<type> keys(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            keys[i] = seed * n + i;
+        }
+        return keys;
+    }
+};
+
+// adversarial: multiples of 1024, which share their low bits under std::hash
+struct StridedKeys {
+    using type = std::uint64_t;
+
+    static std::vector<type> make(std::size_t n, std::uint64_t seed) {
+        std::vector<type> keys(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            keys[i] = (seed * n + i) * 1024;
+        }
+        return keys;
+    }
+};
+
+template<class Map>
+void set_max_load_factor(Map &map, float factor, long) {
+    map.max_load_factor(factor);
+}
+
+// HashMap keeps its maximum load factor above twice the minimum, which low maximums have to make room for first
+template<class Map>
+auto set_max_load_factor(Map &map, float factor, int) -> decltype(map.min_load_factor(factor), void()) {
+    if (2 * map.min_load_factor() >= factor) {
+        map.min_load_factor(factor / 4);
+    }
+    map.max_load_factor(factor);
+}
+
+template<class Map>
+void set_load_factor(Map &map, const benchmark::State &state) {
+    set_max_load_factor(map, static_cast<float>(state.range(1)) / 100, 0);
+}
+
+template<class Map, class Keys>
+Map filled_map(const std::vector<Keys> &keys, const benchmark::State &state) {
+    Map map;
+    set_load_factor(map, state);
+    for (const Keys &key : keys) {
+        map[key] = 1;
+    }
+    return map;
+}
+
+template<template<class> class Map, class Keys>
+void BM_Insert(benchmark::State &state) {
+    using K = typename Keys::type;
+    std::vector<K> keys = Keys::make(static_cast<std::size_t>(state.range(0)), 1);
+    for (auto _ : state) {
+        Map<K> map;
+        set_load_factor(map, state);
+        for (const K &key : keys) {
+            map.insert({key, 1});
+        }
+        benchmark::DoNotOptimize(map);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template<template<class> class Map, class Keys>
+void BM_FindHit(benchmark::State &state) {
+    using K = typename Keys::type;
+    std::vector<K> keys = Keys::make(static_cast<std::size_t>(state.range(0)), 1);
+    Map<K> map = filled_map<Map<K>>(keys, state);
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(2));
+    for (auto _ : state) {
+        for (const K &key : keys) {
+            benchmark::DoNotOptimize(map.find(key));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template<template<class> class Map, class Keys>
+void BM_FindMiss(benchmark::State &state) {
+    using K = typename Keys::type;
+    std::size_t n = static_cast<std::size_t>(state.range(0));
+    Map<K> map = filled_map<Map<K>>(Keys::make(n, 1), state);
+    std::vector<K> missing = Keys::make(n, 2);
+    for (auto _ : state) {
+        for (const K &key : missing) {
+            benchmark::DoNotOptimize(map.find(key));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// erases the oldest key and inserts a new one, so the size stays put while slots turn over
+template<template<class> class Map, class Keys>
+void BM_EraseChurn(benchmark::State &state) {
+    using K = typename Keys::type;
+    std::size_t n = static_cast<std::size_t>(state.range(0));
+    std::vector<K> keys = Keys::make(2 * n, 1);
+    Map<K> map = filled_map<Map<K>>(std::vector<K>(keys.begin(), keys.begin() + n), state);
+    std::size_t oldest = 0;
+    for (auto _ : state) {
+        map.erase(keys[oldest]);
+        map.insert({keys[(oldest + n) % keys.size()], 1});
+        oldest = (oldest + 1) % keys.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// operator[] on keys of which half are present
+template<template<class> class Map, class Keys>
+void BM_Upsert(benchmark::State &state) {
+    using K = typename Keys::type;
+    std::size_t n = static_cast<std::size_t>(state.range(0));
+    std::vector<K> keys = Keys::make(n, 1);
+    std::vector<K> present(keys.begin(), keys.begin() + n / 2);
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(2));
+    for (auto _ : state) {
+        state.PauseTiming();
+        Map<K> map = filled_map<Map<K>>(present, state);
+        state.ResumeTiming();
+        for (const K &key : keys) {
+            ++map[key];
+        }
+        benchmark::DoNotOptimize(map);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template<template<class> class Map, class Keys>
+void BM_Iterate(benchmark::State &state) {
+    using K = typename Keys::type;
+    Map<K> map = filled_map<Map<K>>(Keys::make(static_cast<std::size_t>(state.range(0)), 1), state);
+    for (auto _ : state) {
+        Value sum = 0;
+        for (const auto &element : map) {
+            sum += element.second;
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// one full rehash of a filled map into four times the capacity
+template<template<class> class Map, class Keys>
+void BM_Rehash(benchmark::State &state) {
+    using K = typename Keys::type;
+    std::size_t n = static_cast<std::size_t>(state.range(0));
+    std::vector<K> keys = Keys::make(n, 1);
+    for (auto _ : state) {
+        state.PauseTiming();
+        Map<K> map = filled_map<Map<K>>(keys, state);
+        state.ResumeTiming();
+        map.rehash(4 * n);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// element counts from a few KB (L1) to hundreds of MB (RAM), with the load factors 0.25, 0.5 and 0.8
+void sizes_and_load_factors(benchmark::internal::Benchmark *benchmark) {
+    for (std::int64_t size : {1 << 8, 1 << 13, 1 << 17, 1 << 22}) {
+        for (std::int64_t load_factor : {25, 50, 80}) {
+            benchmark->Args({size, load_factor});
+        }
+    }
+}
+
+void sizes(benchmark::internal::Benchmark *benchmark) {
+    for (std::int64_t size : {1 << 8, 1 << 13, 1 << 17, 1 << 22}) {
+        benchmark->Args({size, 80});
+    }
+}
+
+// adversarial patterns may degrade to quadratic time, so they stay small
+void small_sizes(benchmark::internal::Benchmark *benchmark) {
+    for (std::int64_t size : {1 << 8, 1 << 11, 1 << 14}) {
+        benchmark->Args({size, 80});
+    }
+}
+
+#define MAP_BENCHMARKS(Map, Keys)                                                          \
+    BENCHMARK_TEMPLATE(BM_Insert, Map, Keys)->Apply(sizes_and_load_factors);               \
+    BENCHMARK_TEMPLATE(BM_FindHit, Map, Keys)->Apply(sizes_and_load_factors);              \
+    BENCHMARK_TEMPLATE(BM_FindMiss, Map, Keys)->Apply(sizes_and_load_factors);             \
+    BENCHMARK_TEMPLATE(BM_EraseChurn, Map, Keys)->Apply(sizes);                            \
+    BENCHMARK_TEMPLATE(BM_Upsert, Map, Keys)->Apply(sizes);                                \
+    BENCHMARK_TEMPLATE(BM_Iterate, Map, Keys)->Apply(sizes);                               \
+    BENCHMARK_TEMPLATE(BM_Rehash, Map, Keys)->Apply(sizes)
+
+#define ADVERSARIAL_BENCHMARKS(Map, Keys)                                                  \
+    BENCHMARK_TEMPLATE(BM_Insert, Map, Keys)->Apply(small_sizes);                          \
+    BENCHMARK_TEMPLATE(BM_FindHit, Map, Keys)->Apply(small_sizes);                         \
+    BENCHMARK_TEMPLATE(BM_FindMiss, Map, Keys)->Apply(small_sizes)
+
+#define ALL_BENCHMARKS(Map)                                                                \
+    MAP_BENCHMARKS(Map, IntKeys);                                                          \
+    MAP_BENCHMARKS(Map, Int64Keys);                                                        \
+    MAP_BENCHMARKS(Map, StringKeys);                                                       \
+    ADVERSARIAL_BENCHMARKS(Map, SequentialKeys);                                           \
+    ADVERSARIAL_BENCHMARKS(Map, StridedKeys)
+
+ALL_BENCHMARKS(Coalesced);
+ALL_BENCHMARKS(CoalescedSplit);
+ALL_BENCHMARKS(CoalescedSeeded);
+ALL_BENCHMARKS(StdUnordered);
+#ifdef HAVE_ABSL
+ALL_BENCHMARKS(AbslFlat);
+#endif
+
+BENCHMARK_MAIN();
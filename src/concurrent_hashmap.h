@@ -0,0 +1,397 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "slot_layout.h"
+#include "slot_indexer.h"
+#include "read_epochs.h"
+
+// A coalesced hash map for read-mostly sharing between threads. Lookups take no lock: they walk the chains of the
+// published table and copy the element out, and a seqlock version tells them to retry if a writer changed the table
+// meanwhile. Writers are serialized by a mutex and change slots in place; a grown table is built aside, published
+// with one atomic store and the old one freed after a grace period of ReadEpochs, so no reader ever waits.
+//
+// Readers may copy keys and values while a writer changes them, so both must be trivially copyable, and operator==
+// of the key must not follow pointers.
+template<class KeyType, class ValueType, class Hash = std::hash<KeyType>, class IndexType = std::uint32_t,
+        class Indexer = ModuloIndexer>
+class ConcurrentHashMap {
+    static_assert(std::is_trivially_copyable<KeyType>::value, "KeyType must be trivially copyable");
+    static_assert(std::is_trivially_copyable<ValueType>::value, "ValueType must be trivially copyable");
+    static_assert(std::is_unsigned<IndexType>::value, "IndexType must be an unsigned integer type");
+
+public:
+    ConcurrentHashMap(Hash hash_function = Hash());
+
+    ConcurrentHashMap(std::size_t init_slots_size, Hash hash_function = Hash());
+
+    ConcurrentHashMap(const ConcurrentHashMap &other) = delete;
+
+    ConcurrentHashMap &operator=(const ConcurrentHashMap &other) = delete;
+
+    ~ConcurrentHashMap();
+
+    std::size_t size() const;
+
+    bool empty() const;
+
+    Hash hash_function() const;
+
+    bool find(const KeyType &key, ValueType &value) const;
+
+    bool contains(const KeyType &key) const;
+
+    ValueType at(const KeyType &key) const;
+
+    bool insert(const KeyType &key, const ValueType &value);
+
+    bool insert_or_assign(const KeyType &key, const ValueType &value);
+
+    bool erase(const KeyType &key);
+
+    template<class F>
+    void for_each(F f) const;
+
+    std::size_t slot_count() const;
+
+private:
+    static constexpr IndexType NULL_INDEX = std::numeric_limits<IndexType>::max();
+    static const std::size_t DEFAULT_INIT_SLOTS_SIZE = 1024;
+    static constexpr const float MAX_LOAD_FACTOR = 0.8;
+
+    // links and occupancy are atomic so that readers always walk valid indices, keys and values are only read
+    // through copies that the version check validates
+    struct Slot {
+        std::atomic<IndexType> link{NULL_INDEX};
+        std::atomic<bool> occupied{false};
+        RawStorage<KeyType> key;
+        RawStorage<ValueType> value;
+    };
+
+    // immutable in size once published, so readers see a consistent slot count
+    struct Table {
+        std::size_t size;
+        std::size_t address_size;
+        std::unique_ptr<Slot[]> slots;
+        // only used by writers
+        std::size_t largest_empty;
+
+        explicit Table(std::size_t slots_size);
+    };
+
+    Hash hash_function_;
+    std::atomic<Table *> table_;
+    std::atomic<std::size_t> size_{0};
+    // odd while a writer changes the published table
+    alignas(64) std::atomic<std::uint64_t> version_{0};
+    mutable std::mutex write_mutex_;
+    ReadEpochs epochs_;
+
+    bool insert_(const KeyType &key, const ValueType &value, bool assign);
+
+    void begin_write_();
+
+    void end_write_();
+
+    IndexType find_in_chain_(const Table &table, const KeyType &key, std::size_t hash, IndexType &tail) const;
+
+    IndexType free_slot_(Table &table) const;
+
+    void place_(Table &table, const KeyType &key, const ValueType &value, std::size_t hash);
+
+    void rehash_(std::size_t new_size);
+};
+
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer>
+ConcurrentHashMap<KeyType, ValueType, Hash, IndexType, Indexer>::Table::Table(std::size_t slots_size) {
+    address_size = Indexer::address_size(std::max<std::size_t>(1, slots_size));
+    size = std::max(slots_size, address_size);
+    if (size >= NULL_INDEX) {
+        throw std::length_error("slot count doesn't fit into IndexType");
+    }
+    slots.reset(new Slot[size]);
+    largest_empty = size - 1;
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer>
+ConcurrentHashMap<KeyType, ValueType, Hash, IndexType, Indexer>::ConcurrentHashMap(Hash hash_function)
+        : ConcurrentHashMap(DEFAULT_INIT_SLOTS_SIZE, hash_function) {}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer>
+ConcurrentHashMap<KeyType, ValueType, Hash, IndexType, Indexer>::ConcurrentHashMap(std::size_t init_slots_size, Hash hash_function)
+        : hash_function_(hash_function), table_(new Table(init_slots_size)) {}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer>
+ConcurrentHashMap<KeyType, ValueType, Hash, IndexType, Indexer>::~ConcurrentHashMap() {
+    delete table_.load(std::memory_order_relaxed);
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer>
+std::size_t ConcurrentHashMap<KeyType, ValueType, Hash, IndexType, Indexer>::size() const {
+    return size_.load(std::memory_order_relaxed);
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer>
+bool ConcurrentHashMap<KeyType, ValueType, Hash, IndexType, Indexer>::empty() const {
+    return size() == 0;
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer>
+Hash ConcurrentHashMap<KeyType, ValueType, Hash, IndexType, Indexer>::hash_function() const {
+    return hash_function_;
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer>
+bool ConcurrentHashMap<KeyType, ValueType, Hash, IndexType, Indexer>::find(const KeyType &key, ValueType &value) const {
+    std::size_t hash = hash_function_(key);
+    ReadEpochs::Guard guard(epochs_);
+
+    while (true) {
+        std::uint64_t version = version_.load(std::memory_order_acquire);
+        if (version & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        const Table &table = *table_.load(std::memory_order_acquire);
+        RawStorage<KeyType> slot_key;
+        RawStorage<ValueType> slot_value;
+        bool found = false;
+        std::size_t i = Indexer::index(hash, table.address_size);
+        if (table.slots[i].occupied.load(std::memory_order_relaxed)) {
+            // a concurrent erase can relink chains into a cycle, the step limit ends the walk so the check retries
+            for (std::size_t steps = 0; steps < table.size; ++steps) {
+                std::memcpy(static_cast<void *>(&slot_key), &table.slots[i].key, sizeof(KeyType));
+                if (*slot_key.get() == key) {
+                    std::memcpy(static_cast<void *>(&slot_value), &table.slots[i].value, sizeof(ValueType));
+                    found = true;
+                    break;
+                }
+                IndexType next = table.slots[i].link.load(std::memory_order_relaxed);
+                if (next == NULL_INDEX) {
+                    break;
+                }
+                i = next;
+            }
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (version_.load(std::memory_order_relaxed) == version) {
+            if (found) {
+                std::memcpy(static_cast<void *>(&value), &slot_value, sizeof(ValueType));
+            }
+            return found;
+        }
+    }
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer>
+bool ConcurrentHashMap<KeyType, ValueType, Hash, IndexType, Indexer>::contains(const KeyType &key) const {
+    RawStorage<ValueType> value;
+    return find(key, *value.get());
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer>
+ValueType ConcurrentHashMap<KeyType, ValueType, Hash, IndexType, Indexer>::at(const KeyType &key) const {
+    RawStorage<ValueType> value;
+    if (!find(key, *value.get())) {
+        throw std::out_of_range("");
+    }
+    return *value.get();
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer>
+bool ConcurrentHashMap<KeyType, ValueType, Hash, IndexType, Indexer>::insert(const KeyType &key, const ValueType &value) {
+    return insert_(key, value, false);
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer>
+bool ConcurrentHashMap<KeyType, ValueType, Hash, IndexType, Indexer>::insert_or_assign(const KeyType &key, const ValueType &value) {
+    return insert_(key, value, true);
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer>
+bool ConcurrentHashMap<KeyType, ValueType, Hash, IndexType, Indexer>::erase(const KeyType &key) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    std::size_t hash = hash_function_(key);
+    Table &table = *table_.load(std::memory_order_relaxed);
+    Slot *slots = table.slots.get();
+
+    IndexType i = static_cast<IndexType>(Indexer::index(hash, table.address_size));
+    if (!slots[i].occupied.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    IndexType pi = NULL_INDEX;
+    while (i != NULL_INDEX && !(*slots[i].key.get() == key)) {
+        pi = i;
+        i = slots[i].link.load(std::memory_order_relaxed);
+    }
+    if (i == NULL_INDEX) {
+        return false;
+    }
+
+    // the same relinking as HashMap::erase_, elements later in the chain move into the hole when it is their
+    // hash address
+    begin_write_();
+    slots[i].occupied.store(false, std::memory_order_relaxed);
+    if (pi != NULL_INDEX) {
+        slots[pi].link.store(NULL_INDEX, std::memory_order_relaxed);
+    }
+    IndexType hole = i;
+    i = slots[i].link.load(std::memory_order_relaxed);
+    slots[hole].link.store(NULL_INDEX, std::memory_order_relaxed);
+
+    while (i != NULL_INDEX) {
+        IndexType j = static_cast<IndexType>(Indexer::index(hash_function_(*slots[i].key.get()), table.address_size));
+        if (j == hole) {
+            std::memcpy(static_cast<void *>(&slots[hole].key), &slots[i].key, sizeof(KeyType));
+            std::memcpy(static_cast<void *>(&slots[hole].value), &slots[i].value, sizeof(ValueType));
+            slots[hole].occupied.store(true, std::memory_order_relaxed);
+            slots[i].occupied.store(false, std::memory_order_relaxed);
+            hole = i;
+        } else {
+            while (slots[j].link.load(std::memory_order_relaxed) != NULL_INDEX) {
+                j = slots[j].link.load(std::memory_order_relaxed);
+            }
+            slots[j].link.store(i, std::memory_order_relaxed);
+        }
+        IndexType k = slots[i].link.load(std::memory_order_relaxed);
+        slots[i].link.store(NULL_INDEX, std::memory_order_relaxed);
+        i = k;
+    }
+    end_write_();
+
+    size_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer>
+template<class F>
+void ConcurrentHashMap<KeyType, ValueType, Hash, IndexType, Indexer>::for_each(F f) const {
+    // writers are held off, so the elements can be passed by reference
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    const Table &table = *table_.load(std::memory_order_relaxed);
+    for (std::size_t i = 0; i < table.size; ++i) {
+        if (table.slots[i].occupied.load(std::memory_order_relaxed)) {
+            f(*table.slots[i].key.get(), *table.slots[i].value.get());
+        }
+    }
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer>
+std::size_t ConcurrentHashMap<KeyType, ValueType, Hash, IndexType, Indexer>::slot_count() const {
+    return table_.load(std::memory_order_acquire)->size;
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer>
+bool ConcurrentHashMap<KeyType, ValueType, Hash, IndexType, Indexer>::insert_(const KeyType &key, const ValueType &value, bool assign) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    std::size_t hash = hash_function_(key);
+
+    Table *table = table_.load(std::memory_order_relaxed);
+    IndexType tail;
+    IndexType i = find_in_chain_(*table, key, hash, tail);
+    if (i != NULL_INDEX) {
+        if (assign) {
+            begin_write_();
+            std::memcpy(static_cast<void *>(&table->slots[i].value), &value, sizeof(ValueType));
+            end_write_();
+        }
+        return false;
+    }
+
+    if (size() + 1 > MAX_LOAD_FACTOR * table->size) {
+        rehash_(2 * table->size);
+        table = table_.load(std::memory_order_relaxed);
+    }
+
+    begin_write_();
+    place_(*table, key, value, hash);
+    end_write_();
+    size_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer>
+void ConcurrentHashMap<KeyType, ValueType, Hash, IndexType, Indexer>::begin_write_() {
+    std::uint64_t version = version_.load(std::memory_order_relaxed);
+    version_.store(version + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer>
+void ConcurrentHashMap<KeyType, ValueType, Hash, IndexType, Indexer>::end_write_() {
+    version_.store(version_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer>
+IndexType ConcurrentHashMap<KeyType, ValueType, Hash, IndexType, Indexer>::find_in_chain_(const Table &table, const KeyType &key, std::size_t hash, IndexType &tail) const {
+    tail = NULL_INDEX;
+    IndexType i = static_cast<IndexType>(Indexer::index(hash, table.address_size));
+    if (!table.slots[i].occupied.load(std::memory_order_relaxed)) {
+        return NULL_INDEX;
+    }
+    while (true) {
+        if (*table.slots[i].key.get() == key) {
+            return i;
+        }
+        IndexType next = table.slots[i].link.load(std::memory_order_relaxed);
+        if (next == NULL_INDEX) {
+            tail = i;
+            return NULL_INDEX;
+        }
+        i = next;
+    }
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer>
+IndexType ConcurrentHashMap<KeyType, ValueType, Hash, IndexType, Indexer>::free_slot_(Table &table) const {
+    // erased slots above the cursor are found again after it wraps around, the load limit keeps a slot free
+    while (table.slots[table.largest_empty].occupied.load(std::memory_order_relaxed)) {
+        table.largest_empty = table.largest_empty == 0 ? table.size - 1 : table.largest_empty - 1;
+    }
+    return static_cast<IndexType>(table.largest_empty);
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer>
+void ConcurrentHashMap<KeyType, ValueType, Hash, IndexType, Indexer>::place_(Table &table, const KeyType &key, const ValueType &value, std::size_t hash) {
+    IndexType tail;
+    find_in_chain_(table, key, hash, tail);
+    IndexType i = tail == NULL_INDEX ? static_cast<IndexType>(Indexer::index(hash, table.address_size))
+                                     : free_slot_(table);
+    std::memcpy(static_cast<void *>(&table.slots[i].key), &key, sizeof(KeyType));
+    std::memcpy(static_cast<void *>(&table.slots[i].value), &value, sizeof(ValueType));
+    table.slots[i].occupied.store(true, std::memory_order_relaxed);
+    if (tail != NULL_INDEX) {
+        table.slots[tail].link.store(i, std::memory_order_relaxed);
+    }
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer>
+void ConcurrentHashMap<KeyType, ValueType, Hash, IndexType, Indexer>::rehash_(std::size_t new_size) {
+    Table *old_table = table_.load(std::memory_order_relaxed);
+    std::unique_ptr<Table> new_table(new Table(new_size));
+    // readers don't see the new table before it is published, so it is filled without version changes
+    for (std::size_t i = 0; i < old_table->size; ++i) {
+        if (old_table->slots[i].occupied.load(std::memory_order_relaxed)) {
+            const KeyType &key = *old_table->slots[i].key.get();
+            place_(*new_table, key, *old_table->slots[i].value.get(), hash_function_(key));
+        }
+    }
+
+    table_.store(new_table.release(), std::memory_order_release);
+    epochs_.synchronize();
+    delete old_table;
+}
@@ -6,18 +6,69 @@
 #include <stdexcept>
 #include <new>
 #include <cassert>
+#include <algorithm>
+#include <utility>
+#include <tuple>
+#include <cstdint>
+#include <cmath>
+#include <type_traits>
+#include <memory>
+#include <memory_resource>
+#include <iterator>
+#include <thread>
+#include <mutex>
+#include <exception>
+#include <string>
+#include <chrono>
+
+#include "slot_layout.h"
+#include "slot_indexer.h"
+#include "huge_page_allocator.h"
+#include "mapped_hashmap.h"
+#include "serialization.h"
+#include "map_stats.h"
+#include "seeded_hash.h"
+#include "node_handle.h"
+#include "map_snapshot.h"
+
+// Where a colliding element is linked into the chain of its hash address, following Vitter's LICH, EICH and VICH.
+// LATE appends it to the end of the chain, EARLY links it right after the hash address and VARIED links it after
+// the last cellar slot that directly follows the hash address.
+enum class InsertionMode {
+    LATE,
+    EARLY,
+    VARIED
+};
 
-template<class KeyType, class ValueType, class Hash = std::hash<KeyType>>
+template<class KeyType, class ValueType, class Hash = std::hash<KeyType>, class Layout = InterleavedLayout,
+        class IndexType = std::uint32_t, class Indexer = ModuloIndexer, class HashStorage = NoStoredHash,
+        class Allocator = std::allocator<std::pair<const KeyType, ValueType>>, class Stats = NoStats>
 class HashMap {
+    static_assert(std::is_unsigned<IndexType>::value, "IndexType must be an unsigned integer type");
+
 public:
-    HashMap(Hash hash_function = Hash());
+    HashMap(Hash hash_function = Hash(), const Allocator &allocator = Allocator());
 
-    HashMap(std::size_t init_slots_size, Hash hash_function = Hash());
+    explicit HashMap(const Allocator &allocator);
+
+    HashMap(std::size_t init_slots_size, Hash hash_function = Hash(), const Allocator &allocator = Allocator());
 
     template<class InputIt>
-    HashMap(InputIt first, InputIt last, Hash hash_function = Hash());
+    HashMap(InputIt first, InputIt last, Hash hash_function = Hash(), const Allocator &allocator = Allocator());
+
+    HashMap(std::initializer_list<std::pair<KeyType, ValueType>> init, Hash hash_function = Hash(),
+            const Allocator &allocator = Allocator());
+
+    HashMap(const HashMap &other) = default;
+
+    HashMap(HashMap &&other) noexcept(std::is_nothrow_copy_constructible<Hash>::value);
+
+    HashMap &operator=(const HashMap &other) = default;
+
+    HashMap &operator=(HashMap &&other) noexcept(std::is_nothrow_copy_assignable<Hash>::value &&
+                                                 std::is_nothrow_move_assignable<Table>::value);
 
-    HashMap(std::initializer_list<std::pair<KeyType, ValueType>> init, Hash hash_function = Hash());
+    void swap(HashMap &other) noexcept(std::is_nothrow_swappable<Hash>::value);
 
     std::size_t size() const;
 
@@ -25,14 +76,51 @@ public:
 
     Hash hash_function() const;
 
-    void insert(std::pair<KeyType, ValueType> value);
-
-    void erase(KeyType key);
+    Allocator get_allocator() const;
 
     class iterator;
 
     class const_iterator;
 
+    using node_type = NodeHandle<KeyType, ValueType>;
+
+    using insert_return_type = NodeInsertResult<iterator, node_type>;
+
+    std::pair<iterator, bool> insert(const std::pair<KeyType, ValueType> &value);
+
+    std::pair<iterator, bool> insert(std::pair<KeyType, ValueType> &&value);
+
+    insert_return_type insert(node_type &&node);
+
+    template<class... Args>
+    std::pair<iterator, bool> emplace(Args &&... args);
+
+    template<class... Args>
+    std::pair<iterator, bool> try_emplace(const KeyType &key, Args &&... args);
+
+    template<class... Args>
+    std::pair<iterator, bool> try_emplace(KeyType &&key, Args &&... args);
+
+    template<class M>
+    std::pair<iterator, bool> insert_or_assign(const KeyType &key, M &&obj);
+
+    template<class M>
+    std::pair<iterator, bool> insert_or_assign(KeyType &&key, M &&obj);
+
+    void erase(const KeyType &key);
+
+    template<class K, class H = Hash, class = typename H::is_transparent>
+    void erase(const K &key);
+
+    node_type extract(const KeyType &key);
+
+    template<class K, class H = Hash, class = typename H::is_transparent>
+    node_type extract(const K &key);
+
+    void merge(HashMap &other);
+
+    void merge(HashMap &&other);
+
     iterator begin();
 
     iterator end();
@@ -41,266 +129,1422 @@ public:
 
     const_iterator end() const;
 
-    iterator find(KeyType key);
+    iterator find(const KeyType &key);
+
+    const_iterator find(const KeyType &key) const;
+
+    template<class K, class H = Hash, class = typename H::is_transparent>
+    iterator find(const K &key);
+
+    template<class K, class H = Hash, class = typename H::is_transparent>
+    const_iterator find(const K &key) const;
 
-    const_iterator find(KeyType) const;
+    template<class ForwardIt, class OutputIt>
+    OutputIt find_batch(ForwardIt first, ForwardIt last, OutputIt out);
 
-    ValueType &operator[](KeyType key);
+    template<class ForwardIt, class OutputIt>
+    OutputIt find_batch(ForwardIt first, ForwardIt last, OutputIt out) const;
 
-    const ValueType &at(KeyType key) const;
+    template<class ForwardIt, class OutputIt>
+    OutputIt contains_batch(ForwardIt first, ForwardIt last, OutputIt out) const;
+
+    template<class ForwardIt>
+    std::size_t insert_batch(ForwardIt first, ForwardIt last);
+
+    template<class InputIt>
+    void build(InputIt first, InputIt last, std::size_t size_hint = 0);
+
+    template<class RandomIt>
+    void parallel_build(RandomIt first, RandomIt last, std::size_t threads = std::thread::hardware_concurrency());
+
+    std::vector<std::pair<iterator, iterator>> split_ranges(std::size_t parts);
+
+    std::vector<std::pair<const_iterator, const_iterator>> split_ranges(std::size_t parts) const;
+
+    template<class F>
+    void parallel_for_each(F f, std::size_t threads = std::thread::hardware_concurrency());
+
+    template<class F>
+    void parallel_for_each(F f, std::size_t threads = std::thread::hardware_concurrency()) const;
+
+    ValueType &operator[](const KeyType &key);
+
+    ValueType &operator[](KeyType &&key);
+
+    template<class K, class H = Hash, class = typename H::is_transparent>
+    ValueType &operator[](const K &key);
+
+    const ValueType &at(const KeyType &key) const;
+
+    template<class K, class H = Hash, class = typename H::is_transparent>
+    const ValueType &at(const K &key) const;
 
     void clear();
 
+    bool incremental_rehash() const;
+
+    void incremental_rehash(bool enable);
+
+    bool rehashing() const;
+
+    bool rehash_step(std::size_t n);
+
+    std::size_t slot_count() const;
+
+    float load_factor() const;
+
+    float max_load_factor() const;
+
+    void max_load_factor(float factor);
+
+    float min_load_factor() const;
+
+    void min_load_factor(float factor);
+
+    bool auto_shrink() const;
+
+    void auto_shrink(bool enable);
+
+    void reserve(std::size_t n);
+
+    void rehash(std::size_t n);
+
+    void shrink_to_fit();
+
+    std::size_t rehash_threads() const;
+
+    void rehash_threads(std::size_t threads);
+
+    void parallel_rehash(std::size_t n, std::size_t threads = std::thread::hardware_concurrency());
+
+    float address_factor() const;
+
+    void address_factor(float factor);
+
+    InsertionMode insertion_mode() const;
+
+    void insertion_mode(InsertionMode mode);
+
+    void save(const std::string &path) const;
+
+    static MappedHashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage>
+    map_readonly(const std::string &path, Hash hash_function = Hash());
+
+    void serialize(std::ostream &out, const SerializeOptions &options = SerializeOptions()) const;
+
+    void deserialize(std::istream &in);
+
+    MapSnapshot<HashMap> snapshot() const;
+
+    const Stats &stats() const;
+
+    void reset_stats();
+
+    std::vector<std::size_t> chain_length_histogram() const;
+
+    void reseed();
+
 private:
-    using HashMapClass = HashMap<KeyType, ValueType, Hash>;
+    using HashMapClass = HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>;
 
     Hash hash_function_;
 
-    std::size_t size_;
+    std::size_t size_ = 0;
+
+    using Table = typename Layout::template Table<KeyType, ValueType, IndexType, HashStorage, Allocator>;
+
+    static const IndexType NULL_INDEX = Table::NULL_INDEX;
+    // slots of the first table of a map that was created without any
+    static constexpr std::size_t MIN_SLOTS_SIZE = 8;
+    static constexpr const float DEFAULT_MIN_LOAD_FACTOR = 0.25;
+    static constexpr const float DEFAULT_MAX_LOAD_FACTOR = 0.8;
+    static const std::size_t REHASH_STEP_SLOTS = 16;
+    // an insert that walks a longer chain rehashes under a new seed, if Hash can draw one
+    static const std::size_t RESEED_PROBES = 64;
+    // whether lookups of K compare KeyType as the word key_bits_() returns, in the branchless chain walk of
+    // find_in_chain_; enums must not overload operator==
+    template<class K>
+    static constexpr bool WORD_KEY = std::is_same<K, KeyType>::value && sizeof(KeyType) <= sizeof(std::uint64_t) &&
+                                     ((std::is_integral<KeyType>::value && !std::is_same<KeyType, bool>::value) ||
+                                      std::is_enum<KeyType>::value || std::is_pointer<KeyType>::value);
+    // keys whose chains the batched operations walk side by side
+    static const std::size_t BATCH_SIZE = 16;
+    // below this many elements parallel_build() builds on the calling thread
+    static const std::size_t PARALLEL_BUILD_MIN_SIZE = 1 << 16;
+    // smaller tables are migrated on the calling thread whatever rehash_threads() says
+    static const std::size_t PARALLEL_REHASH_MIN_SIZE = 1 << 16;
+
+    // a default-constructed or moved-from map has no slots at all and allocates them on the next insert
+    Table slots_;
+    IndexType largest_empty_ = 0;
+
+    using IndexAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<IndexType>;
+    using FlagAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<bool>;
+
+    // slots above largest_empty_ freed by erase, which collisions take before moving the cursor further down;
+    // entries that got occupied again as hash addresses are skipped when popped
+    std::vector<IndexType, IndexAllocator> free_slots_;
+    std::vector<bool, FlagAllocator> free_listed_;
+
+    // slots of the previous table while an incremental rehash is in progress;
+    // elements below migrate_index_ have already been moved into slots_
+    Table old_slots_;
+    IndexType migrate_index_ = 0;
+    bool incremental_rehash_ = false;
+    // threads that migrate a whole table at once, when incremental rehashing is off
+    std::size_t rehash_threads_ = 1;
+
+    float min_load_factor_ = DEFAULT_MIN_LOAD_FACTOR;
+    float max_load_factor_ = DEFAULT_MAX_LOAD_FACTOR;
+    bool auto_shrink_ = true;
+    // automatic shrinking never goes below the capacity requested by reserve()
+    std::size_t reserved_slots_ = 0;
+
+    // keys hash into the first address_size_ slots, the rest is the cellar that collisions take first
+    float address_factor_ = 1;
+    std::size_t address_size_ = 0;
+    std::size_t old_address_size_ = 0;
+    InsertionMode insertion_mode_ = InsertionMode::LATE;
+
+    // updated by const lookups too
+    mutable Stats stats_;
+
+    // cleared by an automatic reseed and set again when the table grows, so keys that collide under every seed
+    // can't make every insert rehash
+    bool may_reseed_ = true;
 
-    static const std::size_t NULL_INDEX = std::numeric_limits<std::size_t>::max();
-    static const std::size_t DEFAULT_INIT_SLOTS_SIZE = 1024;
-    static constexpr const double MIN_LOAD_FACTOR = 0.25;
-    static constexpr const double MAX_LOAD_FACTOR = 0.8;
+    void init_empty_(size_t slots_size);
 
-    struct Slot;
+    template<class K>
+    std::size_t hash_(const K &key) const;
 
-    std::vector<Slot> slots_;
-    std::size_t largest_empty_;
+    std::size_t slot_hash_(const Table &table, IndexType i) const;
 
-    void init_empty_(size_t slots_size);
+    IndexType hash_slot_(std::size_t hash) const;
+
+    void assign_slots_(std::size_t slots_size);
+
+    IndexType insertion_point_(IndexType home, IndexType tail) const;
+
+    template<class K, class... Args>
+    std::pair<iterator, bool> try_emplace_(K &&key, Args &&... args);
+
+    template<class K, class... Args>
+    std::pair<iterator, bool> try_emplace_hashed_(std::size_t hash, bool *reseeded, K &&key, Args &&... args);
+
+    template<class K>
+    IndexType find_in_chain_(const K &key, std::size_t hash, IndexType &tail) const;
+
+    template<class K>
+    IndexType find_in_chain_(const K &key, std::size_t hash, IndexType &tail, std::size_t &probes) const;
+
+    IndexType free_slot_(IndexType home, IndexType tail);
+
+    void link_(IndexType i, IndexType home, IndexType tail);
+
+    void release_slot_(IndexType i);
+
+    void reset_free_slots_();
+
+    void migrate_(IndexType j);
+
+    static std::uint64_t key_bits_(const KeyType &key);
+
+    static node_type take_(Table &table, IndexType i);
+
+    template<class K>
+    void erase_(const K &key, node_type *node = nullptr);
+
+    template<class K>
+    IndexType find_index_(const K &key) const;
+
+    template<class ForwardIt, class F>
+    void find_batch_(ForwardIt first, ForwardIt last, F f) const;
+
+    void prepare_build_(std::size_t n);
 
-    std::size_t get_key_slot(const KeyType &key) const;
+    template<class InputIt>
+    void build_(InputIt first, InputIt last, std::size_t n);
+
+    template<class P>
+    void place_overflow_(P &&value, std::size_t hash);
+
+    template<class F>
+    static void run_parallel_(std::size_t threads, F f);
+
+    static std::size_t address_owner_(std::size_t home, std::size_t words, std::size_t owners);
+
+    static std::vector<std::size_t> owner_offsets_(std::vector<std::size_t> &counts, std::size_t ranges,
+                                                   std::size_t owners);
+
+    template<class It, class Map>
+    static std::vector<std::pair<It, It>> split_ranges_(Map *map, std::size_t parts);
+
+    void parallel_migrate_(std::size_t threads);
+
+    template<class K>
+    IndexType find_old_index_(const K &key, std::size_t hash) const;
+
+    typename Table::reference element_(IndexType index);
+
+    typename Table::const_reference element_(IndexType index) const;
+
+    typename Table::pointer element_address_(IndexType index);
+
+    typename Table::const_pointer element_address_(IndexType index) const;
+
+    IndexType next_index_(IndexType index) const;
+
+    void check_slots_size_(std::size_t slots_size) const;
 
     void rehash_(size_t new_size_);
+
+    void reseed_();
 };
 
 
-template<class KeyType, class ValueType, class Hash>
-HashMap<KeyType, ValueType, Hash>::HashMap(Hash hash_function) : hash_function_(hash_function) {
-    init_empty_(DEFAULT_INIT_SLOTS_SIZE);
-}
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::HashMap(Hash hash_function, const Allocator &allocator)
+        : hash_function_(hash_function), slots_(allocator), free_slots_(IndexAllocator(allocator)),
+          free_listed_(FlagAllocator(allocator)), old_slots_(allocator) {}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::HashMap(const Allocator &allocator) : HashMap(Hash(), allocator) {}
 
 
-template<class KeyType, class ValueType, class Hash>
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
 template<class InputIt>
-HashMap<KeyType, ValueType, Hash>::HashMap(InputIt first, InputIt last, Hash hash_function) : hash_function_(
-        hash_function) {
-    init_empty_(DEFAULT_INIT_SLOTS_SIZE);
-    for (auto it = first; it != last; ++it) {
-        insert(*it);
-    }
+HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::HashMap(InputIt first, InputIt last, Hash hash_function,
+                                                                                    const Allocator &allocator)
+        : HashMap(hash_function, allocator) {
+    build(first, last);
 }
 
-template<class KeyType, class ValueType, class Hash>
-HashMap<KeyType, ValueType, Hash>::HashMap(std::initializer_list<std::pair<KeyType, ValueType>> init,
-                                           Hash hash_function) : HashMap(init.begin(), init.end(), hash_function) {}
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::HashMap(std::initializer_list<std::pair<KeyType, ValueType>> init,
+                                           Hash hash_function, const Allocator &allocator)
+        : HashMap(init.begin(), init.end(), hash_function, allocator) {}
 
-template<class KeyType, class ValueType, class Hash>
-std::size_t HashMap<KeyType, ValueType, Hash>::size() const {
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+std::size_t HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::size() const {
     return size_;
 }
 
-template<class KeyType, class ValueType, class Hash>
-bool HashMap<KeyType, ValueType, Hash>::empty() const {
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+bool HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::empty() const {
     return size_ == 0;
 }
 
-template<class KeyType, class ValueType, class Hash>
-Hash HashMap<KeyType, ValueType, Hash>::hash_function() const {
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+Hash HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::hash_function() const {
     return hash_function_;
 }
 
-template<class KeyType, class ValueType, class Hash>
-struct HashMap<KeyType, ValueType, Hash>::Slot {
-    std::pair<const KeyType, ValueType> value;
-    bool empty;
-    std::size_t link;
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+Allocator HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::get_allocator() const {
+    return slots_.get_allocator();
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+std::pair<typename HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::iterator, bool>
+HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::insert(const std::pair<KeyType, ValueType> &value) {
+    return try_emplace_(value.first, value.second);
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+std::pair<typename HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::iterator, bool>
+HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::insert(std::pair<KeyType, ValueType> &&value) {
+    return try_emplace_(std::move(value.first), std::move(value.second));
+}
 
-    void init_empty() {
-        empty = true;
-        link = NULL_INDEX;
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class... Args>
+std::pair<typename HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::iterator, bool>
+HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::emplace(Args &&... args) {
+    std::pair<KeyType, ValueType> value(std::forward<Args>(args)...);
+    return try_emplace_(std::move(value.first), std::move(value.second));
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class... Args>
+std::pair<typename HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::iterator, bool>
+HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::try_emplace(const KeyType &key, Args &&... args) {
+    return try_emplace_(key, std::forward<Args>(args)...);
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class... Args>
+std::pair<typename HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::iterator, bool>
+HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::try_emplace(KeyType &&key, Args &&... args) {
+    return try_emplace_(std::move(key), std::forward<Args>(args)...);
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class M>
+std::pair<typename HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::iterator, bool>
+HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::insert_or_assign(const KeyType &key, M &&obj) {
+    auto result = try_emplace_(key, std::forward<M>(obj));
+    if (!result.second) {
+        result.first->second = std::forward<M>(obj);
     }
+    return result;
+}
 
-    Slot() {
-        init_empty();
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class M>
+std::pair<typename HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::iterator, bool>
+HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::insert_or_assign(KeyType &&key, M &&obj) {
+    auto result = try_emplace_(std::move(key), std::forward<M>(obj));
+    if (!result.second) {
+        result.first->second = std::forward<M>(obj);
     }
+    return result;
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class K, class... Args>
+std::pair<typename HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::iterator, bool>
+HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::try_emplace_(K &&key, Args &&... args) {
+    std::size_t hash = hash_(key);
+    return try_emplace_hashed_(hash, nullptr, std::forward<K>(key), std::forward<Args>(args)...);
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class K, class... Args>
+std::pair<typename HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::iterator, bool>
+HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::try_emplace_hashed_(std::size_t hash, bool *reseeded, K &&key, Args &&... args) {
+    rehash_step(REHASH_STEP_SLOTS);
 
-    void set_value(std::pair<KeyType, ValueType> new_value) {
-        value.first.~KeyType();
-        new(const_cast<KeyType *>(&value.first)) KeyType(new_value.first);
-        value.second = new_value.second;
-        empty = false;
+    IndexType j = find_old_index_(key, hash);
+    if (j != NULL_INDEX) {
+        return std::make_pair(iterator(static_cast<IndexType>(slots_.size() + j), this), false);
     }
 
-    Slot &operator=(const Slot &other) {
-        if (&other == this) {
-            return (*this);
+    IndexType tail;
+    std::size_t probes;
+    IndexType i = find_in_chain_(key, hash, tail, probes);
+    if constexpr (is_reseedable<Hash>::value) {
+        if (i == NULL_INDEX && probes > RESEED_PROBES && may_reseed_) {
+            may_reseed_ = false;
+            reseed_();
+            // hash codes the caller computed before are stale now
+            if (reseeded) {
+                *reseeded = true;
+            }
+            return try_emplace_(std::forward<K>(key), std::forward<Args>(args)...);
         }
+    }
+    stats_.record_insert(probes);
+    if (i != NULL_INDEX) {
+        return std::make_pair(iterator(i, this), false);
+    }
 
-        value.first.~KeyType();
-        new(const_cast<KeyType *>(&value.first)) KeyType(other.value.first);
-        value.second = other.value.second;
+    // grow before placing, so the returned iterator stays valid. The element is then built first, because the
+    // rehash moves elements that the arguments may refer to.
+    IndexType home;
+    if (size_ + 1 > max_load_factor_ * slots_.size()) {
+        std::pair<KeyType, ValueType> value(std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+                                            std::forward_as_tuple(std::forward<Args>(args)...));
+        rehash_(std::max(2 * slots_.size(), MIN_SLOTS_SIZE));
+        find_in_chain_(value.first, hash, tail);
+        home = hash_slot_(hash);
+        i = free_slot_(home, tail);
+        slots_.construct(i, hash, std::move(value));
+    } else {
+        home = hash_slot_(hash);
+        i = free_slot_(home, tail);
+        slots_.construct(i, hash, std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+                         std::forward_as_tuple(std::forward<Args>(args)...));
+    }
+    // linked only once constructed, so a throwing constructor leaves the chains untouched
+    link_(i, home, tail);
+    if (tail != NULL_INDEX) {
+        stats_.record_collision();
+    }
+    ++size_;
+    return std::make_pair(iterator(i, this), true);
+}
 
-        empty = other.empty;
-        link = other.link;
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class K>
+IndexType HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::find_in_chain_(const K &key, std::size_t hash, IndexType &tail) const {
+    std::size_t probes;
+    return find_in_chain_(key, hash, tail, probes);
+}
 
-        return (*this);
+// also counts the slots visited into probes
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class K>
+IndexType HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::find_in_chain_(const K &key, std::size_t hash, IndexType &tail,
+                                                                                              std::size_t &probes) const {
+    tail = NULL_INDEX;
+    probes = 0;
+    if (slots_.size() == 0) {
+        return NULL_INDEX;
     }
-};
-
 
-template<class KeyType, class ValueType, class Hash>
-void HashMap<KeyType, ValueType, Hash>::insert(std::pair<KeyType, ValueType> value) {
-    std::size_t i = get_key_slot(value.first);
+    IndexType i = hash_slot_(hash);
+    probes = 1;
+    if (slots_.empty(i)) {
+        return NULL_INDEX;
+    }
 
-    if (slots_[i].empty) {
-        slots_[i].set_value(value);
-        ++size_;
+    if constexpr (WORD_KEY<K>) {
+        // Comparing a word costs less than a mispredicted branch, so each hop takes a single exit test. The key
+        // difference and the link after NULL_INDEX wrapping to 0 are both zero-tested through their minimum, which
+        // compilers turn into a conditional move; stored hashes would only add a compare.
+        std::uint64_t bits = key_bits_(key);
+        std::uint64_t difference;
+        for (;;) {
+            IndexType next = slots_.link(i);
+            difference = key_bits_(slots_.key(i)) ^ bits;
+            std::uint64_t remaining = static_cast<IndexType>(next + 1);
+            if (std::min(difference, remaining) == 0) {
+                break;
+            }
+            i = next;
+            ++probes;
+        }
+        if (difference == 0) {
+            return i;
+        }
     } else {
-        while (!(slots_[i].value.first == value.first) && slots_[i].link != NULL_INDEX) {
-            i = slots_[i].link;
+        for (;;) {
+            if (slots_.hash_matches(i, hash) && slots_.key(i) == key) {
+                return i;
+            }
+            IndexType next = slots_.link(i);
+            if (next == NULL_INDEX) {
+                break;
+            }
+            i = next;
+            ++probes;
         }
+    }
+    tail = i;
+    return NULL_INDEX;
+}
 
-        if (!(slots_[i].value.first == value.first)) {
-            while (!slots_[largest_empty_].empty) {
-                assert(largest_empty_ != 0);
-                --largest_empty_;
-            }
-            slots_[i].link = largest_empty_;
-            slots_[largest_empty_].set_value(value);
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::prepare_build_(std::size_t n) {
+    clear();
+    std::size_t required_slots = static_cast<std::size_t>(n / max_load_factor_) + 1;
+    if (n != 0 && required_slots > slots_.size()) {
+        assign_slots_(required_slots);
+    }
+}
+
+// Two-pass construction for up to n elements: the first pass places every element whose hash address is still free
+// there, the second one links the rest into the completed chains. Collisions thus never take the hash address of a
+// later element, which keeps chains from coalescing. Elements past the first n are inserted one by one.
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class InputIt>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::build_(InputIt first, InputIt last, std::size_t n) {
+    prepare_build_(n);
+
+    constexpr bool forward = std::is_base_of<std::forward_iterator_tag,
+            typename std::iterator_traits<InputIt>::iterator_category>::value;
+    // a multi-pass range is read again in the second pass, a single pass one is buffered
+    using Overflow = typename std::conditional<forward, InputIt, std::pair<KeyType, ValueType>>::type;
+    std::vector<std::pair<Overflow, std::size_t>> overflow;
+    for (std::size_t seen = 0; seen < n && first != last; ++first, ++seen) {
+        auto &&value = *first;
+        std::size_t hash = hash_(value.first);
+        IndexType home = hash_slot_(hash);
+        if (slots_.empty(home)) {
+            slots_.construct(home, hash, std::forward<decltype(value)>(value));
             ++size_;
+        } else if (!(slots_.hash_matches(home, hash) && slots_.key(home) == value.first)) {
+            if constexpr (forward) {
+                overflow.emplace_back(first, hash);
+            } else {
+                overflow.emplace_back(std::pair<KeyType, ValueType>(std::forward<decltype(value)>(value)), hash);
+            }
+        }
+    }
+
+    for (std::pair<Overflow, std::size_t> &element : overflow) {
+        if constexpr (forward) {
+            place_overflow_(*element.first, element.second);
+        } else {
+            place_overflow_(std::move(element.first), element.second);
+        }
+    }
+    for (; first != last; ++first) {
+        insert(*first);
+    }
+}
+
+// inserts an element whose hash address is taken, the table must have room for it
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class P>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::place_overflow_(P &&value, std::size_t hash) {
+    IndexType tail;
+    if (find_in_chain_(value.first, hash, tail) != NULL_INDEX) {
+        return;
+    }
+    IndexType home = hash_slot_(hash);
+    IndexType i = free_slot_(home, tail);
+    slots_.construct(i, hash, std::forward<P>(value));
+    link_(i, home, tail);
+    ++size_;
+}
+
+// runs f(t) for every t below threads, f(0) on the calling thread, and rethrows the first exception thrown by f
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class F>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::run_parallel_(std::size_t threads, F f) {
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto run = [&](std::size_t t) {
+        try {
+            f(t);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    try {
+        for (std::size_t t = 1; t < threads; ++t) {
+            workers.emplace_back(run, t);
+        }
+    } catch (...) {
+        for (std::thread &worker : workers) {
+            worker.join();
+        }
+        throw;
+    }
+    run(0);
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+// which of owners threads owns the hash address home, when each owns a range of whole bitmap words of words
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+std::size_t HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::address_owner_(std::size_t home, std::size_t words, std::size_t owners) {
+    // thread o owns the words from words * o / owners on, so the owner is the last o starting at or before the word
+    return ((home / BITMAP_WORD_BITS + 1) * owners - 1) / words;
+}
+
+// Turns counts[t * owners + o], how many elements of range t have a hash address that thread o owns, into the offsets
+// at which range t writes them into one array where the elements of every owner follow each other, ordered by range.
+// Returns where the elements of every owner begin, and their total at the end.
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+std::vector<std::size_t> HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::owner_offsets_(std::vector<std::size_t> &counts, std::size_t ranges, std::size_t owners) {
+    std::vector<std::size_t> begins(owners + 1);
+    std::size_t offset = 0;
+    for (std::size_t o = 0; o < owners; ++o) {
+        begins[o] = offset;
+        for (std::size_t t = 0; t < ranges; ++t) {
+            std::size_t count = counts[t * owners + o];
+            counts[t * owners + o] = offset;
+            offset += count;
+        }
+    }
+    begins[owners] = offset;
+    return begins;
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+IndexType HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::free_slot_(IndexType home, IndexType tail) {
+    if (tail == NULL_INDEX) {
+        return home;
+    }
+
+    while (!free_slots_.empty()) {
+        IndexType i = free_slots_.back();
+        free_slots_.pop_back();
+        free_listed_[i] = false;
+        if (slots_.empty(i)) {
+            return i;
         }
     }
 
-    if (size_ > MAX_LOAD_FACTOR * slots_.size()) {
-        rehash_(2 * slots_.size());
+    // every free slot above the cursor is listed, so the load limit guarantees one at or below it
+    std::size_t free_slot = slots_.prev_free(largest_empty_);
+    assert(free_slot != slots_.size());
+    stats_.record_free_slot_scan(largest_empty_ - free_slot);
+    largest_empty_ = static_cast<IndexType>(free_slot);
+    return largest_empty_;
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::link_(IndexType i, IndexType home, IndexType tail) {
+    if (tail == NULL_INDEX) {
+        return;
+    }
+
+    IndexType after = insertion_point_(home, tail);
+    slots_.set_link(i, slots_.link(after));
+    slots_.set_link(after, i);
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::release_slot_(IndexType i) {
+    // the cursor still reaches slots at or below it
+    if (i > largest_empty_ && !free_listed_[i]) {
+        free_slots_.push_back(i);
+        free_listed_[i] = true;
+    }
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::reset_free_slots_() {
+    free_slots_.clear();
+    free_listed_.assign(slots_.size(), false);
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::migrate_(IndexType j) {
+    std::size_t hash = slot_hash_(old_slots_, j);
+    IndexType tail;
+    find_in_chain_(old_slots_.key(j), hash, tail);
+    IndexType home = hash_slot_(hash);
+    IndexType i = free_slot_(home, tail);
+    slots_.relocate(i, old_slots_, j);
+    link_(i, home, tail);
+}
+
+// the word that equal keys of a WORD_KEY type share
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+std::uint64_t HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::key_bits_(const KeyType &key) {
+    if constexpr (std::is_pointer<KeyType>::value) {
+        return reinterpret_cast<std::uintptr_t>(key);
+    } else if constexpr (std::is_enum<KeyType>::value) {
+        return static_cast<std::make_unsigned_t<std::underlying_type_t<KeyType>>>(key);
+    } else {
+        return static_cast<std::make_unsigned_t<KeyType>>(key);
+    }
+}
+
+// moves the element of slot i into a node, the slot still holds the moved-from element
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+typename HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::node_type HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::take_(Table &table, IndexType i) {
+    // keys are stored const only to keep users from changing them, and the slot is destroyed next
+    return node_type(typename node_type::FromMap(), std::move(const_cast<KeyType &>(table.key(i))),
+                     std::move(table.mapped(i)));
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+IndexType HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::insertion_point_(IndexType home, IndexType tail) const {
+    switch (insertion_mode_) {
+        case InsertionMode::EARLY:
+            return home;
+        case InsertionMode::VARIED:
+            while (slots_.link(home) != NULL_INDEX && slots_.link(home) >= address_size_) {
+                home = slots_.link(home);
+            }
+            return home;
+        default:
+            return tail;
+    }
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::erase(const KeyType &key) {
+    erase_(key);
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class K, class H, class>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::erase(const K &key) {
+    erase_(key);
+}
+
+// removes the element with the key and returns it in a node, which is empty if the key is missing
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+typename HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::node_type HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::extract(const KeyType &key) {
+    node_type node;
+    erase_(key, &node);
+    return node;
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class K, class H, class>
+typename HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::node_type HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::extract(const K &key) {
+    node_type node;
+    erase_(key, &node);
+    return node;
+}
+
+// moves the element of a node into the map if its key is missing, otherwise the node comes back in the result
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+typename HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::insert_return_type HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::insert(node_type &&node) {
+    if (node.empty()) {
+        return {end(), false, node_type()};
     }
+    // the key and the value are only moved from if they are inserted
+    std::pair<iterator, bool> result = try_emplace_(std::move(node.key()), std::move(node.mapped()));
+    if (!result.second) {
+        return {result.first, false, std::move(node)};
+    }
+    node.reset();
+    return {result.first, true, node_type()};
 }
 
-template<class KeyType, class ValueType, class Hash>
-void HashMap<KeyType, ValueType, Hash>::erase(KeyType key) {
-    std::size_t i = get_key_slot(key);
+// Moves every element of other whose key is missing here into this map, the others stay in other. The tables of other
+// are taken over whole and its elements moved out of them one by one, into this map or back into other, so nothing is
+// copied and no element is looked up in other. If Hash, the key comparison or a move throws, the elements of other
+// that weren't moved yet are lost.
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::merge(HashMap &other) {
+    if (this == &other || other.empty()) {
+        return;
+    }
+    std::size_t required_slots = static_cast<std::size_t>((size_ + other.size_) / max_load_factor_) + 1;
+    if (required_slots > slots_.size()) {
+        rehash_(required_slots);
+    }
+    HashMap source(std::move(other));
+    for (iterator it = source.begin(); it != source.end(); ++it) {
+        // the key of a source element is moved from only once it has been inserted, the element is destroyed next
+        KeyType &key = const_cast<KeyType &>(it->first);
+        if (!try_emplace_(std::move(key), std::move(it->second)).second) {
+            other.try_emplace_(std::move(key), std::move(it->second));
+        }
+    }
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::merge(HashMap &&other) {
+    merge(other);
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class K>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::erase_(const K &key, node_type *node) {
+    rehash_step(REHASH_STEP_SLOTS);
 
-    if (slots_[i].empty) {
+    if (slots_.size() == 0) {
         return;
     }
 
-    std::size_t pi = NULL_INDEX;
+    std::size_t hash = hash_(key);
+    IndexType i = hash_slot_(hash);
+
+    if (slots_.empty(i)) {
+        i = NULL_INDEX;
+    }
+
+    IndexType pi = NULL_INDEX;
 
-    while (i != NULL_INDEX && slots_[i].value.first != key) {
+    while (i != NULL_INDEX && !(slots_.hash_matches(i, hash) && slots_.key(i) == key)) {
         pi = i;
-        i = slots_[i].link;
+        i = slots_.link(i);
     }
 
     if (i != NULL_INDEX) {
+        if (node) {
+            *node = take_(slots_, i);
+        }
         --size_;
+        slots_.destroy(i);
 
         if (pi != NULL_INDEX) {
-            slots_[pi].link = NULL_INDEX;
+            slots_.set_link(pi, NULL_INDEX);
         }
-        std::size_t hole = i;
-        i = slots_[i].link;
-        slots_[hole].link = NULL_INDEX;
+        IndexType hole = i;
+        i = slots_.link(i);
+        slots_.set_link(hole, NULL_INDEX);
 
         while (i != NULL_INDEX) {
-            std::size_t j = get_key_slot(slots_[i].value.first);
+            std::size_t moved_hash = slot_hash_(slots_, i);
+            IndexType j = hash_slot_(moved_hash);
             if (j == hole) {
-                slots_[hole].set_value(slots_[i].value);
+                slots_.relocate(hole, slots_, i);
                 hole = i;
             } else {
-                while (slots_[j].link != NULL_INDEX) {
-                    j = slots_[j].link;
+                while (slots_.link(j) != NULL_INDEX) {
+                    j = slots_.link(j);
                 }
-                slots_[j].link = i;
+                slots_.set_link(j, i);
             }
-            std::size_t k = slots_[i].link;
-            slots_[i].link = NULL_INDEX;
+            IndexType k = slots_.link(i);
+            slots_.set_link(i, NULL_INDEX);
             i = k;
         }
 
-        slots_[hole].init_empty();
+        slots_.init_empty(hole);
+        release_slot_(hole);
+    } else if (rehashing()) {
+        // the old table is never relinked, so its chains stay walkable through erased slots
+        IndexType j = find_old_index_(key, hash);
+        if (j != NULL_INDEX) {
+            if (node) {
+                *node = take_(old_slots_, j);
+            }
+            --size_;
+            old_slots_.destroy(j);
+        }
     }
 
-    if (size_ < slots_.size() * MIN_LOAD_FACTOR) {
-        rehash_((slots_.size() + 1) / 2);
+    std::size_t shrunk_size = (slots_.size() + 1) / 2;
+    if (auto_shrink_ && size_ < slots_.size() * min_load_factor_ && shrunk_size < slots_.size() &&
+        shrunk_size >= reserved_slots_) {
+        rehash_(shrunk_size);
     }
 }
 
-template<class KeyType, class ValueType, class Hash>
-std::size_t HashMap<KeyType, ValueType, Hash>::get_key_slot(const KeyType &key) const {
-    return hash_function_(key) % slots_.size();
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class K>
+std::size_t HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::hash_(const K &key) const {
+    return hash_function_(key);
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+std::size_t HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::slot_hash_(const Table &table, IndexType i) const {
+    if constexpr (HashStorage::FULL_HASH) {
+        return table.hash(i);
+    } else {
+        return hash_(table.key(i));
+    }
 }
 
-template<class KeyType, class ValueType, class Hash>
-typename HashMap<KeyType, ValueType, Hash>::iterator HashMap<KeyType, ValueType, Hash>::begin() {
-    return ++iterator(NULL_INDEX, &slots_);
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+IndexType HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::hash_slot_(std::size_t hash) const {
+    return static_cast<IndexType>(Indexer::index(hash, address_size_));
 }
 
-template<class KeyType, class ValueType, class Hash>
-typename HashMap<KeyType, ValueType, Hash>::iterator HashMap<KeyType, ValueType, Hash>::end() {
-    return iterator(slots_.size(), &slots_);
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+typename HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::iterator HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::begin() {
+    return ++iterator(NULL_INDEX, this);
 }
 
-template<class KeyType, class ValueType, class Hash>
-typename HashMap<KeyType, ValueType, Hash>::const_iterator HashMap<KeyType, ValueType, Hash>::begin() const {
-    return ++const_iterator(NULL_INDEX, (&slots_));
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+typename HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::iterator HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::end() {
+    return iterator(static_cast<IndexType>(slots_.size() + old_slots_.size()), this);
 }
 
-template<class KeyType, class ValueType, class Hash>
-typename HashMap<KeyType, ValueType, Hash>::const_iterator HashMap<KeyType, ValueType, Hash>::end() const {
-    return const_iterator(slots_.size(), &slots_);
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+typename HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::const_iterator HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::begin() const {
+    return ++const_iterator(NULL_INDEX, this);
 }
 
-template<class KeyType, class ValueType, class Hash>
-typename HashMap<KeyType, ValueType, Hash>::iterator HashMap<KeyType, ValueType, Hash>::find(KeyType key) {
-    std::size_t i = get_key_slot(key);
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+typename HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::const_iterator HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::end() const {
+    return const_iterator(static_cast<IndexType>(slots_.size() + old_slots_.size()), this);
+}
 
-    if (slots_[i].empty) {
-        return end();
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+typename HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::iterator HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::find(const KeyType &key) {
+    rehash_step(REHASH_STEP_SLOTS);
+
+    IndexType i = find_index_(key);
+    if (i != NULL_INDEX) {
+        return iterator(i, this);
+    }
+    return end();
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+typename HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::const_iterator HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::find(const KeyType &key) const {
+    IndexType i = find_index_(key);
+    if (i != NULL_INDEX) {
+        return const_iterator(i, this);
     }
+    return end();
+}
 
-    while (slots_[i].link != NULL_INDEX && !(slots_[i].value.first == key)) {
-        i = slots_[i].link;
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class K, class H, class>
+typename HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::iterator HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::find(const K &key) {
+    rehash_step(REHASH_STEP_SLOTS);
+
+    IndexType i = find_index_(key);
+    if (i != NULL_INDEX) {
+        return iterator(i, this);
     }
+    return end();
+}
 
-    if (slots_[i].value.first == key) {
-        return iterator(i, &slots_);
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class K, class H, class>
+typename HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::const_iterator HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::find(const K &key) const {
+    IndexType i = find_index_(key);
+    if (i != NULL_INDEX) {
+        return const_iterator(i, this);
     }
     return end();
 }
 
-template<class KeyType, class ValueType, class Hash>
-typename HashMap<KeyType, ValueType, Hash>::const_iterator HashMap<KeyType, ValueType, Hash>::find(KeyType key) const {
-    std::size_t i = get_key_slot(key);
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class ForwardIt, class OutputIt>
+OutputIt HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::find_batch(ForwardIt first, ForwardIt last, OutputIt out) {
+    // migrates once up front, a later step would invalidate the iterators already written
+    rehash_step(REHASH_STEP_SLOTS);
+
+    find_batch_(first, last, [this, &out](IndexType i) {
+        *out = i != NULL_INDEX ? iterator(i, this) : end();
+        ++out;
+    });
+    return out;
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class ForwardIt, class OutputIt>
+OutputIt HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::find_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    find_batch_(first, last, [this, &out](IndexType i) {
+        *out = i != NULL_INDEX ? const_iterator(i, this) : end();
+        ++out;
+    });
+    return out;
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class ForwardIt, class OutputIt>
+OutputIt HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::contains_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    find_batch_(first, last, [&out](IndexType i) {
+        *out = i != NULL_INDEX;
+        ++out;
+    });
+    return out;
+}
 
-    if (slots_[i].empty) {
-        return end();
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class ForwardIt>
+std::size_t HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::insert_batch(ForwardIt first, ForwardIt last) {
+    // grows once for the whole batch instead of doubling along the way
+    std::size_t n = static_cast<std::size_t>(std::distance(first, last));
+    std::size_t required_slots = static_cast<std::size_t>((size_ + n) / max_load_factor_) + 1;
+    if (required_slots > slots_.size()) {
+        rehash_(required_slots);
     }
 
-    while (slots_[i].link != NULL_INDEX && slots_[i].value.first != key) {
-        i = slots_[i].link;
+    std::size_t inserted = 0;
+    std::size_t hashes[BATCH_SIZE];
+    while (first != last) {
+        ForwardIt group = first;
+        std::size_t count = 0;
+        for (; count < BATCH_SIZE && first != last; ++first, ++count) {
+            hashes[count] = hash_(first->first);
+            slots_.prefetch(hash_slot_(hashes[count]));
+        }
+        for (std::size_t k = 0; k < count; ++k, ++group) {
+            bool reseeded = false;
+            inserted += try_emplace_hashed_(hashes[k], &reseeded, group->first, group->second).second;
+            if (reseeded) {
+                // the rest of the group was hashed under the old seed
+                ForwardIt rest = group;
+                for (std::size_t r = k + 1; r < count; ++r) {
+                    hashes[r] = hash_((++rest)->first);
+                }
+            }
+        }
     }
+    return inserted;
+}
 
-    if (slots_[i].value.first == key) {
-        return const_iterator(i, &slots_);
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class InputIt>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::build(InputIt first, InputIt last, std::size_t size_hint) {
+    if constexpr (std::is_base_of<std::forward_iterator_tag,
+            typename std::iterator_traits<InputIt>::iterator_category>::value) {
+        build_(first, last, static_cast<std::size_t>(std::distance(first, last)));
+    } else if (size_hint != 0) {
+        build_(first, last, size_hint);
+    } else {
+        // a single pass range has to be counted in a buffer before the table can be sized
+        std::vector<std::pair<KeyType, ValueType>> values(first, last);
+        build_(std::make_move_iterator(values.begin()), std::make_move_iterator(values.end()), values.size());
     }
-    return end();
 }
 
-template<class KeyType, class ValueType, class Hash>
-ValueType &HashMap<KeyType, ValueType, Hash>::operator[](KeyType key) {
-    iterator it = find(key);
+// Like build(), but hashes and places the elements at their hash addresses on several threads. Each thread owns the
+// hash addresses in a range of whole bitmap words, so no two threads write the same slot or occupancy word, and
+// visits only the elements that hash into its range, which the hashing pass sorts out for it.
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class RandomIt>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::parallel_build(RandomIt first, RandomIt last, std::size_t threads) {
+    std::size_t n = static_cast<std::size_t>(last - first);
+    if (threads <= 1 || n < PARALLEL_BUILD_MIN_SIZE) {
+        build(first, last);
+        return;
+    }
+
+    prepare_build_(n);
+    std::size_t words = bitmap_words(address_size_);
+    threads = std::min(threads, words);
+    std::vector<std::size_t> hashes(n);
+    std::vector<IndexType> homes(n);
+    // set for the elements whose hash address holds a different key, they are placed in the second pass
+    std::vector<unsigned char> overflow(n);
+    std::vector<std::size_t> placed(threads);
+    std::vector<std::size_t> counts(threads * threads);
+    try {
+        run_parallel_(threads, [&](std::size_t t) {
+            for (std::size_t k = n * t / threads; k < n * (t + 1) / threads; ++k) {
+                hashes[k] = hash_(first[k].first);
+                homes[k] = hash_slot_(hashes[k]);
+                ++counts[t * threads + address_owner_(homes[k], words, threads)];
+            }
+        });
+        std::vector<std::size_t> begins = owner_offsets_(counts, threads, threads);
+        // the elements by the thread that owns their hash address
+        std::vector<std::size_t> owned(n);
+        run_parallel_(threads, [&](std::size_t t) {
+            for (std::size_t k = n * t / threads; k < n * (t + 1) / threads; ++k) {
+                owned[counts[t * threads + address_owner_(homes[k], words, threads)]++] = k;
+            }
+        });
+        run_parallel_(threads, [&](std::size_t t) {
+            std::size_t count = 0;
+            for (std::size_t o = begins[t]; o < begins[t + 1]; ++o) {
+                std::size_t k = owned[o];
+                IndexType home = homes[k];
+                if (slots_.empty(home)) {
+                    slots_.construct(home, hashes[k], first[k]);
+                    ++count;
+                } else if (!(slots_.hash_matches(home, hashes[k]) && slots_.key(home) == first[k].first)) {
+                    overflow[k] = 1;
+                }
+            }
+            placed[t] = count;
+        });
+    } catch (...) {
+        clear();
+        throw;
+    }
+    for (std::size_t count : placed) {
+        size_ += count;
+    }
+
+    for (std::size_t k = 0; k < n; ++k) {
+        if (overflow[k]) {
+            place_overflow_(first[k], hashes[k]);
+        }
+    }
+}
+
+// splits the elements into parts consecutive ranges over the slots, some of which may be empty, for processing them
+// on several threads. The ranges stay valid until the map is modified, incremental rehash steps included.
+// Tables that copy on write first clone the pages that snapshots share, so the threads never clone one at once.
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+std::vector<std::pair<typename HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::iterator, typename HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::iterator>>
+HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::split_ranges(std::size_t parts) {
+    if constexpr (Table::COPY_ON_WRITE) {
+        slots_.unshare();
+        old_slots_.unshare();
+    }
+    return split_ranges_<iterator>(this, parts);
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+std::vector<std::pair<typename HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::const_iterator, typename HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::const_iterator>>
+HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::split_ranges(std::size_t parts) const {
+    return split_ranges_<const_iterator>(this, parts);
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class It, class Map>
+std::vector<std::pair<It, It>> HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::split_ranges_(Map *map, std::size_t parts) {
+    parts = std::max<std::size_t>(parts, 1);
+    std::size_t total = map->slots_.size() + map->old_slots_.size();
+    std::vector<std::pair<It, It>> ranges;
+    ranges.reserve(parts);
+    // a range starts at the first element at or after its first slot, the one before slot 0 is NULL_INDEX
+    It begin(map->next_index_(NULL_INDEX), map);
+    for (std::size_t part = 1; part <= parts; ++part) {
+        std::size_t position = total * part / parts;
+        It end(part == parts ? static_cast<IndexType>(total) : map->next_index_(static_cast<IndexType>(position - 1)),
+               map);
+        ranges.emplace_back(begin, end);
+        begin = end;
+    }
+    return ranges;
+}
+
+// calls f on every element, on several threads at once, so f must be safe to call concurrently for distinct
+// elements. Incremental rehashing makes no progress meanwhile.
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class F>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::parallel_for_each(F f, std::size_t threads) {
+    std::vector<std::pair<iterator, iterator>> ranges = split_ranges(threads);
+    run_parallel_(ranges.size(), [&](std::size_t t) {
+        for (iterator it = ranges[t].first; it != ranges[t].second; ++it) {
+            f(*it);
+        }
+    });
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class F>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::parallel_for_each(F f, std::size_t threads) const {
+    std::vector<std::pair<const_iterator, const_iterator>> ranges = split_ranges(threads);
+    run_parallel_(ranges.size(), [&](std::size_t t) {
+        for (const_iterator it = ranges[t].first; it != ranges[t].second; ++it) {
+            f(*it);
+        }
+    });
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class K>
+IndexType HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::find_index_(const K &key) const {
+    std::size_t hash = hash_(key);
+    IndexType tail;
+    std::size_t probes;
+    IndexType i = find_in_chain_(key, hash, tail, probes);
+    stats_.record_find(probes);
+    if (i != NULL_INDEX) {
+        return i;
+    }
+
+    IndexType j = find_old_index_(key, hash);
+    if (j != NULL_INDEX) {
+        return static_cast<IndexType>(slots_.size() + j);
+    }
+    return NULL_INDEX;
+}
+
+// Takes BATCH_SIZE keys at a time: hashes them all and prefetches their hash addresses, then walks their chains in
+// lockstep, one hop per key and round with the next slot prefetched, so the cache misses of the keys overlap.
+// f gets the unified index of each key in order, or NULL_INDEX.
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class ForwardIt, class F>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::find_batch_(ForwardIt first, ForwardIt last, F f) const {
+    ForwardIt keys[BATCH_SIZE];
+    std::size_t hashes[BATCH_SIZE];
+    IndexType slots[BATCH_SIZE];
+    // the slots visited for each key, counted like find_in_chain_ does for the stats
+    std::size_t probes[BATCH_SIZE];
+    while (first != last) {
+        std::size_t count = 0;
+        for (; count < BATCH_SIZE && first != last; ++first, ++count) {
+            keys[count] = first;
+            hashes[count] = hash_(*first);
+            slots[count] = NULL_INDEX;
+            probes[count] = 0;
+            if (slots_.size() != 0) {
+                slots[count] = hash_slot_(hashes[count]);
+                probes[count] = 1;
+                slots_.prefetch(slots[count]);
+            }
+        }
+
+        // bit k is set while the chain of key k is still being walked
+        std::uint32_t pending = 0;
+        for (std::size_t k = 0; k < count; ++k) {
+            if (slots[k] != NULL_INDEX && !slots_.empty(slots[k])) {
+                pending |= std::uint32_t(1) << k;
+            } else {
+                slots[k] = NULL_INDEX;
+            }
+        }
+        while (pending != 0) {
+            for (std::size_t k = 0; k < count; ++k) {
+                if (!(pending >> k & 1)) {
+                    continue;
+                }
+                IndexType i = slots[k];
+                if (slots_.hash_matches(i, hashes[k]) && slots_.key(i) == *keys[k]) {
+                    pending &= ~(std::uint32_t(1) << k);
+                } else if (slots_.link(i) == NULL_INDEX) {
+                    slots[k] = NULL_INDEX;
+                    pending &= ~(std::uint32_t(1) << k);
+                } else {
+                    slots[k] = slots_.link(i);
+                    ++probes[k];
+                    slots_.prefetch(slots[k]);
+                }
+            }
+        }
+
+        for (std::size_t k = 0; k < count; ++k) {
+            stats_.record_find(probes[k]);
+            IndexType i = slots[k];
+            if (i == NULL_INDEX) {
+                IndexType j = find_old_index_(*keys[k], hashes[k]);
+                if (j != NULL_INDEX) {
+                    i = static_cast<IndexType>(slots_.size() + j);
+                }
+            }
+            f(i);
+        }
+    }
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class K>
+IndexType HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::find_old_index_(const K &key, std::size_t hash) const {
+    if (!rehashing()) {
+        return NULL_INDEX;
+    }
+
+    // migrated and erased slots are marked empty but keep their links
+    IndexType i = static_cast<IndexType>(Indexer::index(hash, old_address_size_));
+    while (i != NULL_INDEX) {
+        if (!old_slots_.empty(i) && old_slots_.hash_matches(i, hash) && old_slots_.key(i) == key) {
+            return i;
+        }
+        i = old_slots_.link(i);
+    }
+    return NULL_INDEX;
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+typename HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::Table::reference
+HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::element_(IndexType index) {
+    if (index < slots_.size()) {
+        return slots_.value(index);
+    }
+    return old_slots_.value(index - slots_.size());
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+typename HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::Table::const_reference
+HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::element_(IndexType index) const {
+    if (index < slots_.size()) {
+        return slots_.value(index);
+    }
+    return old_slots_.value(index - slots_.size());
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+typename HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::Table::pointer
+HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::element_address_(IndexType index) {
+    if (index < slots_.size()) {
+        return slots_.address(index);
+    }
+    return old_slots_.address(index - slots_.size());
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+typename HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::Table::const_pointer
+HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::element_address_(IndexType index) const {
+    if (index < slots_.size()) {
+        return slots_.address(index);
+    }
+    return old_slots_.address(index - slots_.size());
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+IndexType HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::next_index_(IndexType index) const {
+    IndexType end_index = static_cast<IndexType>(slots_.size() + old_slots_.size());
+    if (index == end_index) {
+        return index;
+    }
+    ++index;
+    if (index < slots_.size()) {
+        index = slots_.next_occupied(index);
+        if (index < slots_.size()) {
+            return index;
+        }
+    }
+    return static_cast<IndexType>(slots_.size() + old_slots_.next_occupied(index - slots_.size()));
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+ValueType &HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::operator[](const KeyType &key) {
+    return try_emplace_(key).first->second;
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+ValueType &HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::operator[](KeyType &&key) {
+    return try_emplace_(std::move(key)).first->second;
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class K, class H, class>
+ValueType &HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::operator[](const K &key) {
+    return try_emplace_(key).first->second;
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+const ValueType &HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::at(const KeyType &key) const {
+    const_iterator it = find(key);
     if (it != end()) {
         return it->second;
-    } else {
-        insert(std::pair<KeyType, ValueType>(key, ValueType()));
-        return find(key)->second;
     }
+    throw std::out_of_range("");
 }
 
-template<class KeyType, class ValueType, class Hash>
-const ValueType &HashMap<KeyType, ValueType, Hash>::at(KeyType key) const {
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+template<class K, class H, class>
+const ValueType &HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::at(const K &key) const {
     const_iterator it = find(key);
     if (it != end()) {
         return it->second;
@@ -309,53 +1553,639 @@ const ValueType &HashMap<KeyType, ValueType, Hash>::at(KeyType key) const {
 }
 
 
-template<class KeyType, class ValueType, class Hash>
-void HashMap<KeyType, ValueType, Hash>::clear() {
-    (*this) = HashMap<KeyType, ValueType, Hash>();
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::clear() {
+    old_slots_.clear();
+    migrate_index_ = 0;
+
+    if constexpr (Table::COPY_ON_WRITE) {
+        // resetting slots in place would clone every page a snapshot still shares
+        slots_.assign(slots_.size());
+    } else {
+        // empty slots of the current table are never linked, so only occupied ones need a reset
+        for (std::size_t i = slots_.next_occupied(0); i < slots_.size(); i = slots_.next_occupied(i + 1)) {
+            slots_.init_empty(i);
+        }
+    }
+    largest_empty_ = static_cast<IndexType>(slots_.size() == 0 ? 0 : slots_.size() - 1);
+    reset_free_slots_();
+    size_ = 0;
 }
 
-template<class KeyType, class ValueType, class Hash>
-void HashMap<KeyType, ValueType, Hash>::init_empty_(size_t slots_size) {
-    slots_.assign(slots_size, Slot());
-    largest_empty_ = slots_.size() - 1;
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::init_empty_(size_t slots_size) {
+    // no slots at all until the first insert
+    if (slots_size != 0) {
+        assign_slots_(slots_size);
+    }
     size_ = 0;
 }
 
-template<class KeyType, class ValueType, class Hash>
-HashMap<KeyType, ValueType, Hash>::HashMap(std::size_t init_slots_size, Hash hash_function) {
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::assign_slots_(std::size_t slots_size) {
+    // the indexer may round the address region up, the cellar then keeps its share of the table
+    std::size_t requested_address_size = static_cast<std::size_t>(slots_size * address_factor_);
+    std::size_t address_size = Indexer::address_size(std::max<std::size_t>(1, requested_address_size));
+    slots_size = std::max(slots_size, static_cast<std::size_t>(std::ceil(address_size / address_factor_)));
+
+    check_slots_size_(slots_size + old_slots_.size());
+    slots_.assign(slots_size);
+    address_size_ = address_size;
+    largest_empty_ = static_cast<IndexType>(slots_.size() - 1);
+    reset_free_slots_();
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::HashMap(std::size_t init_slots_size, Hash hash_function, const Allocator &allocator)
+        : hash_function_(hash_function), slots_(allocator), free_slots_(IndexAllocator(allocator)),
+          free_listed_(FlagAllocator(allocator)), old_slots_(allocator) {
     init_empty_(init_slots_size);
 }
 
-template<class KeyType, class ValueType, class Hash>
-void HashMap<KeyType, ValueType, Hash>::rehash_(size_t new_size_) {
-    std::vector<std::pair<const KeyType, ValueType>> elements;
-    for (const auto &x: *this) {
-        elements.push_back(x);
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::HashMap(HashMap &&other) noexcept(std::is_nothrow_copy_constructible<Hash>::value)
+        : hash_function_(other.hash_function_), size_(other.size_), slots_(std::move(other.slots_)),
+          largest_empty_(other.largest_empty_), free_slots_(std::move(other.free_slots_)),
+          free_listed_(std::move(other.free_listed_)), old_slots_(std::move(other.old_slots_)),
+          migrate_index_(other.migrate_index_), incremental_rehash_(other.incremental_rehash_),
+          rehash_threads_(other.rehash_threads_), min_load_factor_(other.min_load_factor_), max_load_factor_(other.max_load_factor_),
+          auto_shrink_(other.auto_shrink_), reserved_slots_(other.reserved_slots_),
+          address_factor_(other.address_factor_), address_size_(other.address_size_),
+          old_address_size_(other.old_address_size_), insertion_mode_(other.insertion_mode_), stats_(other.stats_),
+          may_reseed_(other.may_reseed_) {
+    // the moved-from map keeps its hash function and settings, but no slots
+    other.size_ = 0;
+    other.largest_empty_ = 0;
+    other.free_slots_.clear();
+    other.free_listed_.clear();
+    other.migrate_index_ = 0;
+    other.address_size_ = 0;
+    other.old_address_size_ = 0;
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats> &HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::operator=(HashMap &&other) noexcept(
+        std::is_nothrow_copy_assignable<Hash>::value && std::is_nothrow_move_assignable<Table>::value) {
+    if (this == &other) {
+        return *this;
     }
-    init_empty_(new_size_);
-    for (const auto &x: elements) {
-        insert(x);
+    // the tables take over the storage of other or, with an unequal allocator, move its elements one by one
+    slots_ = std::move(other.slots_);
+    free_slots_ = std::move(other.free_slots_);
+    free_listed_ = std::move(other.free_listed_);
+    old_slots_ = std::move(other.old_slots_);
+    hash_function_ = other.hash_function_;
+    size_ = other.size_;
+    largest_empty_ = other.largest_empty_;
+    migrate_index_ = other.migrate_index_;
+    incremental_rehash_ = other.incremental_rehash_;
+    rehash_threads_ = other.rehash_threads_;
+    min_load_factor_ = other.min_load_factor_;
+    max_load_factor_ = other.max_load_factor_;
+    auto_shrink_ = other.auto_shrink_;
+    reserved_slots_ = other.reserved_slots_;
+    address_factor_ = other.address_factor_;
+    address_size_ = other.address_size_;
+    old_address_size_ = other.old_address_size_;
+    insertion_mode_ = other.insertion_mode_;
+    stats_ = other.stats_;
+    may_reseed_ = other.may_reseed_;
+
+    other.size_ = 0;
+    other.largest_empty_ = 0;
+    other.free_slots_.clear();
+    other.free_listed_.clear();
+    other.migrate_index_ = 0;
+    other.address_size_ = 0;
+    other.old_address_size_ = 0;
+    return *this;
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::swap(HashMap &other) noexcept(std::is_nothrow_swappable<Hash>::value) {
+    using std::swap;
+    swap(hash_function_, other.hash_function_);
+    swap(size_, other.size_);
+    slots_.swap(other.slots_);
+    swap(largest_empty_, other.largest_empty_);
+    free_slots_.swap(other.free_slots_);
+    free_listed_.swap(other.free_listed_);
+    old_slots_.swap(other.old_slots_);
+    swap(migrate_index_, other.migrate_index_);
+    swap(incremental_rehash_, other.incremental_rehash_);
+    swap(rehash_threads_, other.rehash_threads_);
+    swap(min_load_factor_, other.min_load_factor_);
+    swap(max_load_factor_, other.max_load_factor_);
+    swap(auto_shrink_, other.auto_shrink_);
+    swap(reserved_slots_, other.reserved_slots_);
+    swap(address_factor_, other.address_factor_);
+    swap(address_size_, other.address_size_);
+    swap(old_address_size_, other.old_address_size_);
+    swap(insertion_mode_, other.insertion_mode_);
+    swap(stats_, other.stats_);
+    swap(may_reseed_, other.may_reseed_);
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void swap(HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats> &first,
+          HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats> &second) noexcept(
+        std::is_nothrow_swappable<Hash>::value) {
+    first.swap(second);
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+bool HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::incremental_rehash() const {
+    return incremental_rehash_;
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::incremental_rehash(bool enable) {
+    incremental_rehash_ = enable;
+    if (!enable) {
+        rehash_step(old_slots_.size());
+    }
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+bool HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::rehashing() const {
+    return old_slots_.size() != 0;
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+bool HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::rehash_step(std::size_t n) {
+    // most calls find no migration in progress, and those never read the clock
+    std::chrono::steady_clock::time_point start;
+    bool timed = Stats::ENABLED && n > 0 && migrate_index_ < old_slots_.size();
+    if (timed) {
+        start = std::chrono::steady_clock::now();
+    }
+    while (n > 0 && migrate_index_ < old_slots_.size()) {
+        if (!old_slots_.empty(migrate_index_)) {
+            migrate_(migrate_index_);
+        }
+        ++migrate_index_;
+        --n;
+    }
+    if (timed) {
+        stats_.record_rehash_time(std::chrono::steady_clock::now() - start);
+    }
+
+    if (rehashing() && migrate_index_ == old_slots_.size()) {
+        old_slots_.clear();
+        migrate_index_ = 0;
+    }
+    return rehashing();
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+std::size_t HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::slot_count() const {
+    return slots_.size();
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+float HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::load_factor() const {
+    return slots_.size() == 0 ? 0 : static_cast<float>(size_) / slots_.size();
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+float HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::max_load_factor() const {
+    return max_load_factor_;
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::max_load_factor(float factor) {
+    // a coalesced table needs a free slot for every collision, so it can never be completely full
+    if (!(factor > 2 * min_load_factor_ && factor < 1)) {
+        throw std::invalid_argument("max load factor must be in (2 * min_load_factor, 1)");
+    }
+    max_load_factor_ = factor;
+    if (size_ > max_load_factor_ * slots_.size()) {
+        rehash(0);
+    }
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+float HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::min_load_factor() const {
+    return min_load_factor_;
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::min_load_factor(float factor) {
+    // halving the table doubles the load, so a larger factor would make erase and insert thrash
+    if (!(factor >= 0 && 2 * factor < max_load_factor_)) {
+        throw std::invalid_argument("min load factor must be in [0, max_load_factor / 2)");
+    }
+    min_load_factor_ = factor;
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+bool HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::auto_shrink() const {
+    return auto_shrink_;
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::auto_shrink(bool enable) {
+    auto_shrink_ = enable;
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::reserve(std::size_t n) {
+    std::size_t required_slots = static_cast<std::size_t>(n / max_load_factor_) + 1;
+    reserved_slots_ = required_slots;
+    if (required_slots > slots_.size()) {
+        rehash_(required_slots);
+    }
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::rehash(std::size_t n) {
+    std::size_t required_slots = static_cast<std::size_t>(size_ / max_load_factor_) + 1;
+    rehash_(std::max(n, required_slots));
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::shrink_to_fit() {
+    reserved_slots_ = 0;
+    rehash(0);
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+std::size_t HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::rehash_threads() const {
+    return rehash_threads_;
+}
+
+// with incremental rehashing off, tables of at least PARALLEL_REHASH_MIN_SIZE slots are migrated on this many
+// threads, provided keys and values move without throwing
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::rehash_threads(std::size_t threads) {
+    if (threads == 0) {
+        throw std::invalid_argument("rehash threads must be positive");
+    }
+    rehash_threads_ = threads;
+}
+
+// rehash(n) on the given number of threads, finishing the migration before it returns
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::parallel_rehash(std::size_t n, std::size_t threads) {
+    rehash_step(old_slots_.size());
+    std::size_t rehash_threads = rehash_threads_;
+    bool incremental = incremental_rehash_;
+    rehash_threads_ = std::max<std::size_t>(threads, 1);
+    incremental_rehash_ = false;
+    try {
+        rehash(n);
+    } catch (...) {
+        rehash_threads_ = rehash_threads;
+        incremental_rehash_ = incremental;
+        throw;
+    }
+    rehash_threads_ = rehash_threads;
+    incremental_rehash_ = incremental;
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+float HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::address_factor() const {
+    return address_factor_;
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::address_factor(float factor) {
+    if (!(factor > 0 && factor <= 1)) {
+        throw std::invalid_argument("address factor must be in (0, 1]");
+    }
+    address_factor_ = factor;
+    if (slots_.size() == 0) {
+        return;
+    }
+    // every key changes its hash address, so the table is rebuilt at once
+    rehash_step(old_slots_.size());
+    bool incremental = incremental_rehash_;
+    incremental_rehash_ = false;
+    rehash_(slots_.size());
+    incremental_rehash_ = incremental;
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+InsertionMode HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::insertion_mode() const {
+    return insertion_mode_;
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::insertion_mode(InsertionMode mode) {
+    insertion_mode_ = mode;
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::save(const std::string &path) const {
+    if (rehashing()) {
+        // snapshots hold a single table, so the copy finishes the migration first
+        HashMap copy(*this);
+        copy.rehash_step(copy.old_slots_.size());
+        copy.save(path);
+        return;
     }
+    save_snapshot<Table, KeyType, ValueType, IndexType, Indexer, HashStorage>(path, slots_, address_size_, size_,
+                                                                           hash_function_);
 }
 
-template<class KeyType, class ValueType, class Hash>
-class HashMap<KeyType, ValueType, Hash>::iterator {
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+MappedHashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage>
+HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::map_readonly(const std::string &path, Hash hash_function) {
+    return MappedHashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage>(path, hash_function);
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::serialize(std::ostream &out, const SerializeOptions &options) const {
+    StreamWriter<KeyType, ValueType> writer(out, options, size_);
+    for (const_iterator it = begin(); it != end(); ++it) {
+        writer.add((*it).first, (*it).second);
+    }
+    writer.finish();
+}
+
+// A read-only copy that keeps the current contents while the map changes. Only what lookups and iteration read is
+// copied; with PagedLayout that shares the pages instead of copying elements, so it costs O(pages), other layouts
+// copy every slot.
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+MapSnapshot<HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>>
+HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::snapshot() const {
+    HashMap copy(hash_function_, slots_.get_allocator());
+    copy.slots_ = slots_;
+    copy.old_slots_ = old_slots_;
+    copy.size_ = size_;
+    copy.migrate_index_ = migrate_index_;
+    copy.address_size_ = address_size_;
+    copy.old_address_size_ = old_address_size_;
+    return MapSnapshot<HashMap>(std::move(copy));
+}
+
+// Replaces the contents with the elements of a stream written by serialize(). The elements are decoded chunk by
+// chunk straight into build(), which buffers only those that collide. The table is sized up front only for as many
+// elements as the stream can hold, further ones grow it as they are decoded. On an exception the map is left empty.
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::deserialize(std::istream &in) {
+    try {
+        StreamReader<KeyType, ValueType> reader(in);
+        build(reader.begin(), reader.end(), reader.size_hint());
+        reader.finish();
+    } catch (...) {
+        clear();
+        throw;
+    }
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::check_slots_size_(std::size_t slots_size) const {
+    // NULL_INDEX is reserved, and while migrating iterator indices span both tables
+    if (slots_size >= NULL_INDEX) {
+        throw std::length_error("slot count doesn't fit into IndexType");
+    }
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+const Stats &HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::stats() const {
+    return stats_;
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::reset_stats() {
+    stats_ = Stats();
+}
+
+// element k counts the linked lists of k slots in the current table, element 0 is always 0. Chains that coalesced
+// share one list, which is what lookups of their keys walk through. Elements still waiting in the table of an
+// incremental rehash are not counted.
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+std::vector<std::size_t> HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::chain_length_histogram() const {
+    std::vector<std::size_t> histogram(1, 0);
+    // chains start at the occupied slots that no link points to
+    std::vector<bool> linked(slots_.size(), false);
+    for (std::size_t i = slots_.next_occupied(0); i < slots_.size(); i = slots_.next_occupied(i + 1)) {
+        if (slots_.link(static_cast<IndexType>(i)) != NULL_INDEX) {
+            linked[slots_.link(static_cast<IndexType>(i))] = true;
+        }
+    }
+    for (std::size_t i = slots_.next_occupied(0); i < slots_.size(); i = slots_.next_occupied(i + 1)) {
+        if (linked[i]) {
+            continue;
+        }
+        std::size_t length = 1;
+        for (IndexType j = slots_.link(static_cast<IndexType>(i)); j != NULL_INDEX; j = slots_.link(j)) {
+            ++length;
+        }
+        if (length >= histogram.size()) {
+            histogram.resize(length + 1, 0);
+        }
+        ++histogram[length];
+    }
+    return histogram;
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::reseed() {
+    static_assert(is_reseedable<Hash>::value, "reseed() needs a Hash with a reseed() member, e.g. SeededHash");
+    reseed_();
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::rehash_(size_t new_size_) {
+    // a table can only be migrated from one predecessor at a time
+    rehash_step(old_slots_.size());
+
+    old_slots_.swap(slots_);
+    old_address_size_ = address_size_;
+    std::chrono::steady_clock::time_point start;
+    if (Stats::ENABLED) {
+        start = std::chrono::steady_clock::now();
+    }
+    try {
+        assign_slots_(new_size_);
+    } catch (...) {
+        slots_.swap(old_slots_);
+        old_slots_.clear();
+        throw;
+    }
+    if (Stats::ENABLED) {
+        stats_.record_rehash_time(std::chrono::steady_clock::now() - start);
+    }
+    stats_.record_rehash();
+    if (slots_.size() > old_slots_.size()) {
+        may_reseed_ = true;
+    }
+    migrate_index_ = 0;
+
+    if (!incremental_rehash_) {
+        // threads must not clone pages of shared tables concurrently
+        if constexpr (std::is_nothrow_move_constructible<KeyType>::value &&
+                      std::is_nothrow_move_constructible<ValueType>::value && !Table::COPY_ON_WRITE) {
+            if (rehash_threads_ > 1 && old_slots_.size() >= PARALLEL_REHASH_MIN_SIZE) {
+                parallel_migrate_(rehash_threads_);
+                return;
+            }
+        }
+        rehash_step(old_slots_.size());
+    }
+}
+
+// Migrates all of old_slots_ in three passes. The first hashes the old slots, split into ranges, on all threads, and
+// sorts them by the thread that owns their hash address. In the second every thread owns the hash addresses in a range
+// of whole bitmap words of the new table and moves the elements it was handed that find theirs free into it, the old
+// slots stay marked occupied so that no two threads write one occupancy word. The last links the remaining elements
+// into collision slots on the calling thread. Moving must not throw; if hashing throws, the map keeps both tables as if
+// an incremental rehash had just started.
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::parallel_migrate_(std::size_t threads) {
+    std::chrono::steady_clock::time_point start;
+    if (Stats::ENABLED) {
+        start = std::chrono::steady_clock::now();
+    }
+    std::size_t n = old_slots_.size();
+    std::vector<std::size_t> hashes(n);
+    std::vector<IndexType> homes(n);
+    // set for the elements whose hash address was taken, they are placed in the last pass
+    std::vector<unsigned char> overflow(n);
+    std::size_t words = bitmap_words(address_size_);
+    std::size_t placing_threads = std::min(threads, words);
+    std::vector<std::size_t> counts(threads * placing_threads);
+    run_parallel_(threads, [&](std::size_t t) {
+        std::size_t end = n * (t + 1) / threads;
+        for (std::size_t j = old_slots_.next_occupied(n * t / threads); j < end; j = old_slots_.next_occupied(j + 1)) {
+            hashes[j] = slot_hash_(old_slots_, static_cast<IndexType>(j));
+            homes[j] = hash_slot_(hashes[j]);
+            ++counts[t * placing_threads + address_owner_(homes[j], words, placing_threads)];
+        }
+    });
+
+    std::vector<std::size_t> begins = owner_offsets_(counts, threads, placing_threads);
+    // the occupied old slots by the thread that owns their hash address
+    std::vector<IndexType> owned(begins[placing_threads]);
+    run_parallel_(threads, [&](std::size_t t) {
+        std::size_t end = n * (t + 1) / threads;
+        for (std::size_t j = old_slots_.next_occupied(n * t / threads); j < end; j = old_slots_.next_occupied(j + 1)) {
+            owned[counts[t * placing_threads + address_owner_(homes[j], words, placing_threads)]++] =
+                    static_cast<IndexType>(j);
+        }
+    });
+    run_parallel_(placing_threads, [&](std::size_t t) {
+        for (std::size_t o = begins[t]; o < begins[t + 1]; ++o) {
+            IndexType j = owned[o];
+            IndexType home = homes[j];
+            if (slots_.empty(home)) {
+                slots_.relocate_element(home, old_slots_, j);
+            } else {
+                overflow[j] = 1;
+            }
+        }
+    });
+
+    for (std::size_t j = 0; j < n; ++j) {
+        if (overflow[j]) {
+            IndexType tail;
+            find_in_chain_(old_slots_.key(static_cast<IndexType>(j)), hashes[j], tail);
+            IndexType i = free_slot_(homes[j], tail);
+            slots_.relocate_element(i, old_slots_, static_cast<IndexType>(j));
+            link_(i, homes[j], tail);
+        }
+    }
+    old_slots_.forget_elements();
+    old_slots_.clear();
+    migrate_index_ = 0;
+    if (Stats::ENABLED) {
+        stats_.record_rehash_time(std::chrono::steady_clock::now() - start);
+    }
+}
+
+// draws a new seed and rebuilds the table at its size, which breaks up chains of keys chosen to collide under the
+// old seed
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+void HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::reseed_() {
+    if constexpr (is_reseedable<Hash>::value) {
+        rehash_step(old_slots_.size());
+        Hash old_hash_function = hash_function_;
+        hash_function_.reseed();
+        for (std::size_t i = slots_.next_occupied(0); i < slots_.size(); i = slots_.next_occupied(i + 1)) {
+            slots_.set_hash(i, hash_(slots_.key(static_cast<IndexType>(i))));
+        }
+        bool incremental = incremental_rehash_;
+        incremental_rehash_ = false;
+        try {
+            rehash_(slots_.size());
+        } catch (...) {
+            // the table wasn't replaced, so it goes back to the seed it is laid out for
+            incremental_rehash_ = incremental;
+            hash_function_ = old_hash_function;
+            for (std::size_t i = slots_.next_occupied(0); i < slots_.size(); i = slots_.next_occupied(i + 1)) {
+                slots_.set_hash(i, hash_(slots_.key(static_cast<IndexType>(i))));
+            }
+            throw;
+        }
+        incremental_rehash_ = incremental;
+        stats_.record_reseed();
+    }
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+class HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::iterator {
 public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::pair<const KeyType, ValueType>;
+    using difference_type = std::ptrdiff_t;
+    using reference = typename Table::reference;
+    using pointer = typename Table::pointer;
+
     iterator() {
         index_ = 0;
-        slots_ = nullptr;
+        map_ = nullptr;
     }
 
-    iterator(std::size_t index, std::vector<Slot> *slots) : index_(index), slots_(slots) {}
+    iterator(IndexType index, HashMapClass *map) : index_(index), map_(map) {}
 
     iterator &operator++() {
-        if (index_ == slots_->size()) {
-            return *this;
-        }
-        ++index_;
-        while (index_ < slots_->size() && (*slots_)[index_].empty) {
-            ++index_;
-        }
+        index_ = map_->next_index_(index_);
         return *this;
     }
 
@@ -365,46 +2195,47 @@ public:
         return ret_it;
     }
 
-    bool operator==(const iterator &other) {
-        return index_ == other.index_ && slots_ == other.slots_;
+    bool operator==(const iterator &other) const {
+        return index_ == other.index_ && map_ == other.map_;
     }
 
-    bool operator!=(const iterator &other) {
+    bool operator!=(const iterator &other) const {
         return !(*this == other);
     }
 
-    std::pair<const KeyType, ValueType> &operator*() {
-        return (*slots_)[index_].value;
+    typename Table::reference operator*() const {
+        return map_->element_(index_);
     }
 
-    std::pair<const KeyType, ValueType> *operator->() {
-        return (&(*slots_)[index_].value);
+    typename Table::pointer operator->() const {
+        return map_->element_address_(index_);
     }
 
 private:
-    std::size_t index_;
-    std::vector<Slot> *slots_;
+    IndexType index_;
+    HashMapClass *map_;
 };
 
 
-template<class KeyType, class ValueType, class Hash>
-class HashMap<KeyType, ValueType, Hash>::const_iterator {
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer,
+        class HashStorage, class Allocator, class Stats>
+class HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage, Allocator, Stats>::const_iterator {
 public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::pair<const KeyType, ValueType>;
+    using difference_type = std::ptrdiff_t;
+    using reference = typename Table::const_reference;
+    using pointer = typename Table::const_pointer;
+
     const_iterator() {
         index_ = 0;
-        slots_ = nullptr;
+        map_ = nullptr;
     }
 
-    const_iterator(std::size_t index, const std::vector<Slot> *slots) : index_(index), slots_(slots) {}
+    const_iterator(IndexType index, const HashMapClass *map) : index_(index), map_(map) {}
 
     const_iterator &operator++() {
-        if (index_ == slots_->size()) {
-            return *this;
-        }
-        ++index_;
-        while (index_ < slots_->size() && (*slots_)[index_].empty) {
-            ++index_;
-        }
+        index_ = map_->next_index_(index_);
         return *this;
     }
 
@@ -414,23 +2245,31 @@ public:
         return ret_it;
     }
 
-    bool operator==(const const_iterator &other) {
-        return index_ == other.index_ && slots_ == other.slots_;
+    bool operator==(const const_iterator &other) const {
+        return index_ == other.index_ && map_ == other.map_;
     }
 
-    bool operator!=(const const_iterator &other) {
+    bool operator!=(const const_iterator &other) const {
         return !(*this == other);
     }
 
-    const std::pair<const KeyType, ValueType> &operator*() {
-        return (*slots_)[index_].value;
+    typename Table::const_reference operator*() const {
+        return map_->element_(index_);
     }
 
-    const std::pair<const KeyType, ValueType> *operator->() {
-        return &(*slots_)[index_].value;
+    typename Table::const_pointer operator->() const {
+        return map_->element_address_(index_);
     }
 
 private:
-    std::size_t index_;
-    const std::vector<Slot> *slots_;
-};
\ No newline at end of file
+    IndexType index_;
+    const HashMapClass *map_;
+};
+namespace pmr {
+// HashMap with slots from a std::pmr::memory_resource, e.g. a per-request monotonic arena
+template<class KeyType, class ValueType, class Hash = std::hash<KeyType>, class Layout = InterleavedLayout,
+        class IndexType = std::uint32_t, class Indexer = ModuloIndexer, class HashStorage = NoStoredHash,
+        class Stats = NoStats>
+using HashMap = ::HashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage,
+        std::pmr::polymorphic_allocator<std::pair<const KeyType, ValueType>>, Stats>;
+} // namespace pmr
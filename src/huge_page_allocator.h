@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+// Backs allocations of at least Threshold bytes with 2MB-aligned anonymous mappings that are advised to use
+// transparent huge pages, so chain walks over a large table need far fewer TLB entries. Smaller allocations, and
+// every allocation on systems without madvise, go to operator new. Mappings are committed lazily by the kernel, so
+// reserving a large table doesn't touch its memory up front.
+template<class T, std::size_t Threshold = std::size_t(1) << 21>
+class HugePageAllocator {
+public:
+    using value_type = T;
+
+    static constexpr std::size_t HUGE_PAGE_SIZE = std::size_t(1) << 21;
+
+    template<class U>
+    struct rebind {
+        using other = HugePageAllocator<U, Threshold>;
+    };
+
+    HugePageAllocator() = default;
+
+    template<class U>
+    HugePageAllocator(const HugePageAllocator<U, Threshold> &) {}
+
+    T *allocate(std::size_t n) {
+        if (n > static_cast<std::size_t>(-1) / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+        std::size_t bytes = n * sizeof(T);
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+        if (bytes >= Threshold) {
+            return static_cast<T *>(map_huge_pages_(bytes));
+        }
+#endif
+        return static_cast<T *>(::operator new(bytes));
+    }
+
+    void deallocate(T *pointer, std::size_t n) {
+        std::size_t bytes = n * sizeof(T);
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+        if (bytes >= Threshold) {
+            munmap(pointer, round_up_(bytes));
+            return;
+        }
+#endif
+        ::operator delete(pointer);
+    }
+
+    template<class U>
+    bool operator==(const HugePageAllocator<U, Threshold> &) const {
+        return true;
+    }
+
+    template<class U>
+    bool operator!=(const HugePageAllocator<U, Threshold> &) const {
+        return false;
+    }
+
+private:
+    static std::size_t round_up_(std::size_t bytes) {
+        return (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    }
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    // maps one huge page more than needed and unmaps the unaligned head and tail
+    static void *map_huge_pages_(std::size_t bytes) {
+        std::size_t size = round_up_(bytes);
+        void *mapping = mmap(nullptr, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1,
+                             0);
+        if (mapping == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        char *begin = static_cast<char *>(mapping);
+        char *aligned = reinterpret_cast<char *>(
+                (reinterpret_cast<std::uintptr_t>(begin) + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE);
+        if (aligned != begin) {
+            munmap(begin, aligned - begin);
+        }
+        std::size_t tail = HUGE_PAGE_SIZE - (aligned - begin);
+        if (tail != 0) {
+            munmap(aligned + size, tail);
+        }
+        // only a hint, the mapping works with normal pages when the kernel has transparent huge pages disabled
+        madvise(aligned, size, MADV_HUGEPAGE);
+        return aligned;
+    }
+#endif
+};
@@ -0,0 +1,486 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "slot_layout.h"
+#include "slot_indexer.h"
+
+// A coalesced hash table of fixed capacity that evicts the least recently used element to make room for a new one.
+// The recency list is threaded through the slots by index next to the chain links, so a lookup that refreshes an
+// element touches no memory beyond its slot and its neighbours in the list. The table is allocated once by the
+// constructor, sized for capacity elements at a load factor of 0.8, and never grows or shrinks.
+//
+// With a time to live, elements older than that count as missing. They are removed when a lookup or insert runs into
+// them or when they are the least recently used one, and take up capacity until then.
+template<class KeyType, class ValueType, class Hash = std::hash<KeyType>, class IndexType = std::uint32_t,
+        class Indexer = ModuloIndexer, class Clock = std::chrono::steady_clock>
+class LruCache {
+    static_assert(std::is_unsigned<IndexType>::value, "IndexType must be an unsigned integer type");
+
+public:
+    using duration = typename Clock::duration;
+
+    explicit LruCache(std::size_t capacity, Hash hash_function = Hash());
+
+    // a zero time to live is none at all
+    LruCache(std::size_t capacity, duration time_to_live, Hash hash_function = Hash());
+
+    LruCache(const LruCache &other) = delete;
+
+    LruCache &operator=(const LruCache &other) = delete;
+
+    std::size_t size() const;
+
+    bool empty() const;
+
+    std::size_t capacity() const;
+
+    duration time_to_live() const;
+
+    Hash hash_function() const;
+
+    ValueType *find(const KeyType &key);
+
+    const ValueType *peek(const KeyType &key) const;
+
+    bool contains(const KeyType &key) const;
+
+    template<class... Args>
+    std::pair<ValueType *, bool> try_emplace(const KeyType &key, Args &&... args);
+
+    template<class... Args>
+    std::pair<ValueType *, bool> try_emplace(KeyType &&key, Args &&... args);
+
+    template<class M>
+    std::pair<ValueType *, bool> insert_or_assign(const KeyType &key, M &&obj);
+
+    template<class M>
+    std::pair<ValueType *, bool> insert_or_assign(KeyType &&key, M &&obj);
+
+    bool erase(const KeyType &key);
+
+    void clear();
+
+    template<class F>
+    void for_each(F f) const;
+
+    std::size_t evictions() const;
+
+private:
+    using time_point = typename Clock::time_point;
+
+    // the mapped part of an element, with its neighbours in the recency list
+    struct Entry {
+        ValueType value;
+        IndexType newer;
+        IndexType older;
+        time_point expires;
+
+        template<class... Args>
+        explicit Entry(Args &&... args) : value(std::forward<Args>(args)...) {}
+    };
+
+    using Table = typename InterleavedLayout::template Table<KeyType, Entry, IndexType, NoStoredHash,
+            std::allocator<std::pair<const KeyType, Entry>>>;
+
+    static constexpr IndexType NULL_INDEX = Table::NULL_INDEX;
+    static constexpr const float MAX_LOAD_FACTOR = 0.8;
+
+    Hash hash_function_;
+    Table slots_;
+    std::size_t address_size_ = 0;
+    std::size_t capacity_;
+    std::size_t size_ = 0;
+    duration time_to_live_;
+    std::size_t evictions_ = 0;
+
+    // most and least recently used elements
+    IndexType newest_ = NULL_INDEX;
+    IndexType oldest_ = NULL_INDEX;
+
+    // free slots for collisions, as in HashMap: a cursor moving down and the slots freed above it
+    IndexType largest_empty_ = 0;
+    std::vector<IndexType> free_slots_;
+    std::vector<bool> free_listed_;
+
+    IndexType hash_slot_(const KeyType &key) const;
+
+    IndexType find_in_chain_(const KeyType &key, IndexType &tail) const;
+
+    bool expired_(IndexType i) const;
+
+    template<class K, class... Args>
+    std::pair<ValueType *, bool> try_emplace_(K &&key, Args &&... args);
+
+    IndexType free_slot_();
+
+    void erase_(const KeyType &key);
+
+    Entry &entry_(IndexType i);
+
+    void unlink_(IndexType i);
+
+    void push_newest_(IndexType i);
+
+    void moved_(IndexType to);
+};
+
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer, class Clock>
+LruCache<KeyType, ValueType, Hash, IndexType, Indexer, Clock>::LruCache(std::size_t capacity, Hash hash_function)
+        : LruCache(capacity, duration::zero(), hash_function) {}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer, class Clock>
+LruCache<KeyType, ValueType, Hash, IndexType, Indexer, Clock>::LruCache(std::size_t capacity, duration time_to_live,
+                                                                        Hash hash_function)
+        : hash_function_(hash_function), capacity_(capacity), time_to_live_(time_to_live) {
+    if (capacity == 0) {
+        throw std::invalid_argument("cache capacity must be positive");
+    }
+    if (time_to_live < duration::zero()) {
+        throw std::invalid_argument("time to live must not be negative");
+    }
+    // capacity elements always leave a free slot for a collision
+    std::size_t slots_size = static_cast<std::size_t>(capacity / MAX_LOAD_FACTOR) + 1;
+    address_size_ = Indexer::address_size(slots_size);
+    slots_size = std::max(slots_size, address_size_);
+    if (slots_size >= NULL_INDEX) {
+        throw std::length_error("slot count doesn't fit into IndexType");
+    }
+    slots_.assign(slots_size);
+    largest_empty_ = static_cast<IndexType>(slots_size - 1);
+    free_listed_.assign(slots_size, false);
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer, class Clock>
+std::size_t LruCache<KeyType, ValueType, Hash, IndexType, Indexer, Clock>::size() const {
+    return size_;
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer, class Clock>
+bool LruCache<KeyType, ValueType, Hash, IndexType, Indexer, Clock>::empty() const {
+    return size_ == 0;
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer, class Clock>
+std::size_t LruCache<KeyType, ValueType, Hash, IndexType, Indexer, Clock>::capacity() const {
+    return capacity_;
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer, class Clock>
+typename LruCache<KeyType, ValueType, Hash, IndexType, Indexer, Clock>::duration
+LruCache<KeyType, ValueType, Hash, IndexType, Indexer, Clock>::time_to_live() const {
+    return time_to_live_;
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer, class Clock>
+Hash LruCache<KeyType, ValueType, Hash, IndexType, Indexer, Clock>::hash_function() const {
+    return hash_function_;
+}
+
+// the value of the key, which becomes the most recently used one, or nullptr
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer, class Clock>
+ValueType *LruCache<KeyType, ValueType, Hash, IndexType, Indexer, Clock>::find(const KeyType &key) {
+    IndexType tail;
+    IndexType i = find_in_chain_(key, tail);
+    if (i == NULL_INDEX) {
+        return nullptr;
+    }
+    if (expired_(i)) {
+        erase_(key);
+        return nullptr;
+    }
+    unlink_(i);
+    push_newest_(i);
+    return &entry_(i).value;
+}
+
+// like find, but leaves the recency order and expired elements alone
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer, class Clock>
+const ValueType *LruCache<KeyType, ValueType, Hash, IndexType, Indexer, Clock>::peek(const KeyType &key) const {
+    IndexType tail;
+    IndexType i = find_in_chain_(key, tail);
+    if (i == NULL_INDEX || expired_(i)) {
+        return nullptr;
+    }
+    return &slots_.value(i).second.value;
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer, class Clock>
+bool LruCache<KeyType, ValueType, Hash, IndexType, Indexer, Clock>::contains(const KeyType &key) const {
+    return peek(key) != nullptr;
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer, class Clock>
+template<class... Args>
+std::pair<ValueType *, bool> LruCache<KeyType, ValueType, Hash, IndexType, Indexer, Clock>::try_emplace(const KeyType &key, Args &&... args) {
+    return try_emplace_(key, std::forward<Args>(args)...);
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer, class Clock>
+template<class... Args>
+std::pair<ValueType *, bool> LruCache<KeyType, ValueType, Hash, IndexType, Indexer, Clock>::try_emplace(KeyType &&key, Args &&... args) {
+    return try_emplace_(std::move(key), std::forward<Args>(args)...);
+}
+
+// an assigned element becomes the most recently used one and lives for another time to live
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer, class Clock>
+template<class M>
+std::pair<ValueType *, bool> LruCache<KeyType, ValueType, Hash, IndexType, Indexer, Clock>::insert_or_assign(const KeyType &key, M &&obj) {
+    std::pair<ValueType *, bool> result = try_emplace_(key, std::forward<M>(obj));
+    if (!result.second) {
+        *result.first = std::forward<M>(obj);
+        if (time_to_live_ != duration::zero()) {
+            entry_(newest_).expires = Clock::now() + time_to_live_;
+        }
+    }
+    return result;
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer, class Clock>
+template<class M>
+std::pair<ValueType *, bool> LruCache<KeyType, ValueType, Hash, IndexType, Indexer, Clock>::insert_or_assign(KeyType &&key, M &&obj) {
+    std::pair<ValueType *, bool> result = try_emplace_(std::move(key), std::forward<M>(obj));
+    if (!result.second) {
+        *result.first = std::forward<M>(obj);
+        if (time_to_live_ != duration::zero()) {
+            entry_(newest_).expires = Clock::now() + time_to_live_;
+        }
+    }
+    return result;
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer, class Clock>
+bool LruCache<KeyType, ValueType, Hash, IndexType, Indexer, Clock>::erase(const KeyType &key) {
+    std::size_t size = size_;
+    erase_(key);
+    return size_ != size;
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer, class Clock>
+void LruCache<KeyType, ValueType, Hash, IndexType, Indexer, Clock>::clear() {
+    for (std::size_t i = 0; i < slots_.size(); ++i) {
+        slots_.init_empty(i);
+    }
+    size_ = 0;
+    newest_ = NULL_INDEX;
+    oldest_ = NULL_INDEX;
+    largest_empty_ = static_cast<IndexType>(slots_.size() - 1);
+    free_slots_.clear();
+    free_listed_.assign(slots_.size(), false);
+}
+
+// calls f(key, value) from the most to the least recently used element, expired ones included
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer, class Clock>
+template<class F>
+void LruCache<KeyType, ValueType, Hash, IndexType, Indexer, Clock>::for_each(F f) const {
+    for (IndexType i = newest_; i != NULL_INDEX; i = slots_.value(i).second.older) {
+        f(slots_.key(i), static_cast<const ValueType &>(slots_.value(i).second.value));
+    }
+}
+
+// elements removed to make room for others, expired ones included
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer, class Clock>
+std::size_t LruCache<KeyType, ValueType, Hash, IndexType, Indexer, Clock>::evictions() const {
+    return evictions_;
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer, class Clock>
+IndexType LruCache<KeyType, ValueType, Hash, IndexType, Indexer, Clock>::hash_slot_(const KeyType &key) const {
+    return static_cast<IndexType>(Indexer::index(hash_function_(key), address_size_));
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer, class Clock>
+IndexType LruCache<KeyType, ValueType, Hash, IndexType, Indexer, Clock>::find_in_chain_(const KeyType &key, IndexType &tail) const {
+    tail = NULL_INDEX;
+    IndexType i = hash_slot_(key);
+    if (slots_.empty(i)) {
+        return NULL_INDEX;
+    }
+    for (;;) {
+        if (slots_.key(i) == key) {
+            return i;
+        }
+        IndexType next = slots_.link(i);
+        if (next == NULL_INDEX) {
+            break;
+        }
+        i = next;
+    }
+    tail = i;
+    return NULL_INDEX;
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer, class Clock>
+bool LruCache<KeyType, ValueType, Hash, IndexType, Indexer, Clock>::expired_(IndexType i) const {
+    return time_to_live_ != duration::zero() && Clock::now() >= slots_.value(i).second.expires;
+}
+
+// The new element takes the place of the least recently used one when the cache is full. If constructing it throws,
+// the cache is left without the evicted element.
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer, class Clock>
+template<class K, class... Args>
+std::pair<ValueType *, bool> LruCache<KeyType, ValueType, Hash, IndexType, Indexer, Clock>::try_emplace_(K &&key, Args &&... args) {
+    IndexType tail;
+    IndexType i = find_in_chain_(key, tail);
+    bool erased = i != NULL_INDEX;
+    if (erased) {
+        if (!expired_(i)) {
+            unlink_(i);
+            push_newest_(i);
+            return {&entry_(i).value, false};
+        }
+        erase_(key);
+    }
+    if (size_ == capacity_) {
+        erase_(slots_.key(oldest_));
+        ++evictions_;
+        erased = true;
+    }
+    if (erased) {
+        // erasing relinks chains, so the tail of the key's chain is looked up again
+        find_in_chain_(key, tail);
+    }
+
+    IndexType home = hash_slot_(key);
+    i = tail == NULL_INDEX ? home : free_slot_();
+    slots_.construct(i, 0, std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+                     std::forward_as_tuple(std::forward<Args>(args)...));
+    if (tail != NULL_INDEX) {
+        slots_.set_link(i, slots_.link(tail));
+        slots_.set_link(tail, i);
+    }
+    if (time_to_live_ != duration::zero()) {
+        entry_(i).expires = Clock::now() + time_to_live_;
+    }
+    push_newest_(i);
+    ++size_;
+    return {&entry_(i).value, true};
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer, class Clock>
+IndexType LruCache<KeyType, ValueType, Hash, IndexType, Indexer, Clock>::free_slot_() {
+    while (!free_slots_.empty()) {
+        IndexType i = free_slots_.back();
+        free_slots_.pop_back();
+        free_listed_[i] = false;
+        if (slots_.empty(i)) {
+            return i;
+        }
+    }
+    // every free slot above the cursor is listed, and the table always has more slots than capacity
+    largest_empty_ = static_cast<IndexType>(slots_.prev_free(largest_empty_));
+    return largest_empty_;
+}
+
+// removes the element like HashMap::erase does, keeping the recency list of the elements it moves up their chain
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer, class Clock>
+void LruCache<KeyType, ValueType, Hash, IndexType, Indexer, Clock>::erase_(const KeyType &key) {
+    IndexType i = hash_slot_(key);
+    if (slots_.empty(i)) {
+        return;
+    }
+    IndexType pi = NULL_INDEX;
+    while (i != NULL_INDEX && !(slots_.key(i) == key)) {
+        pi = i;
+        i = slots_.link(i);
+    }
+    if (i == NULL_INDEX) {
+        return;
+    }
+
+    unlink_(i);
+    --size_;
+    // key may live in the slot, so it isn't used from here on
+    slots_.destroy(i);
+    if (pi != NULL_INDEX) {
+        slots_.set_link(pi, NULL_INDEX);
+    }
+    IndexType hole = i;
+    i = slots_.link(i);
+    slots_.set_link(hole, NULL_INDEX);
+
+    while (i != NULL_INDEX) {
+        IndexType j = hash_slot_(slots_.key(i));
+        if (j == hole) {
+            slots_.relocate(hole, slots_, i);
+            moved_(hole);
+            hole = i;
+        } else {
+            while (slots_.link(j) != NULL_INDEX) {
+                j = slots_.link(j);
+            }
+            slots_.set_link(j, i);
+        }
+        IndexType k = slots_.link(i);
+        slots_.set_link(i, NULL_INDEX);
+        i = k;
+    }
+
+    slots_.init_empty(hole);
+    if (hole > largest_empty_ && !free_listed_[hole]) {
+        free_slots_.push_back(hole);
+        free_listed_[hole] = true;
+    }
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer, class Clock>
+typename LruCache<KeyType, ValueType, Hash, IndexType, Indexer, Clock>::Entry &
+LruCache<KeyType, ValueType, Hash, IndexType, Indexer, Clock>::entry_(IndexType i) {
+    return slots_.mapped(i);
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer, class Clock>
+void LruCache<KeyType, ValueType, Hash, IndexType, Indexer, Clock>::unlink_(IndexType i) {
+    Entry &entry = entry_(i);
+    if (entry.newer != NULL_INDEX) {
+        entry_(entry.newer).older = entry.older;
+    } else {
+        newest_ = entry.older;
+    }
+    if (entry.older != NULL_INDEX) {
+        entry_(entry.older).newer = entry.newer;
+    } else {
+        oldest_ = entry.newer;
+    }
+}
+
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer, class Clock>
+void LruCache<KeyType, ValueType, Hash, IndexType, Indexer, Clock>::push_newest_(IndexType i) {
+    Entry &entry = entry_(i);
+    entry.newer = NULL_INDEX;
+    entry.older = newest_;
+    if (newest_ != NULL_INDEX) {
+        entry_(newest_).newer = i;
+    } else {
+        oldest_ = i;
+    }
+    newest_ = i;
+}
+
+// points the neighbours of an element that was relocated into slot to at its new slot
+template<class KeyType, class ValueType, class Hash, class IndexType, class Indexer, class Clock>
+void LruCache<KeyType, ValueType, Hash, IndexType, Indexer, Clock>::moved_(IndexType to) {
+    Entry &entry = entry_(to);
+    if (entry.newer != NULL_INDEX) {
+        entry_(entry.newer).older = to;
+    } else {
+        newest_ = to;
+    }
+    if (entry.older != NULL_INDEX) {
+        entry_(entry.older).newer = to;
+    } else {
+        oldest_ = to;
+    }
+}
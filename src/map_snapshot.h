@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <type_traits>
+#include <utility>
+
+#include "serialization.h"
+
+// A read-only copy of a HashMap taken by HashMap::snapshot(). With PagedLayout the copy shares the pages of the map,
+// so taking it costs one reference per page, and the map clones a page the first time it writes to it afterwards.
+// The snapshot keeps the contents the map had when it was taken and may be read, iterated or serialized on another
+// thread while the map keeps changing; one snapshot isn't safe to read from several threads if Map counts stats.
+template<class Map>
+class MapSnapshot {
+public:
+    using const_iterator = typename Map::const_iterator;
+    using value_type = typename const_iterator::value_type;
+    using key_type = typename std::remove_const<typename value_type::first_type>::type;
+    using mapped_type = typename value_type::second_type;
+
+    MapSnapshot(MapSnapshot &&other) = default;
+
+    MapSnapshot &operator=(MapSnapshot &&other) = default;
+
+    std::size_t size() const {
+        return map_.size();
+    }
+
+    bool empty() const {
+        return map_.empty();
+    }
+
+    const_iterator begin() const {
+        return map_.begin();
+    }
+
+    const_iterator end() const {
+        return map_.end();
+    }
+
+    const_iterator find(const key_type &key) const {
+        return map_.find(key);
+    }
+
+    const mapped_type &at(const key_type &key) const {
+        return map_.at(key);
+    }
+
+    void serialize(std::ostream &out, const SerializeOptions &options = SerializeOptions()) const {
+        map_.serialize(out, options);
+    }
+
+private:
+    friend Map;
+
+    Map map_;
+
+    explicit MapSnapshot(Map &&map) : map_(std::move(map)) {}
+};
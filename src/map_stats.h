@@ -0,0 +1,92 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Statistics policies. The map reports probes, collisions, rehashes and free slot scans to its Stats object; with
+// NoStats every call is an empty inline function and the map pays nothing for them.
+
+// Records nothing.
+struct NoStats {
+    static constexpr bool ENABLED = false;
+
+    void record_find(std::size_t) {}
+
+    void record_insert(std::size_t) {}
+
+    void record_collision() {}
+
+    void record_rehash() {}
+
+    void record_rehash_time(std::chrono::nanoseconds) {}
+
+    void record_reseed() {}
+
+    void record_free_slot_scan(std::size_t) {}
+};
+
+// Counts everything in plain integers. Lookups on a const map update the counters too, so a map shared between
+// reading threads needs external synchronization once it counts.
+struct CountingStats {
+    static constexpr bool ENABLED = true;
+
+    // slots visited by find, at and the batched lookups, and by inserting methods before they place or find the key
+    std::uint64_t finds = 0;
+    std::uint64_t find_probes = 0;
+    std::uint64_t max_find_probes = 0;
+    std::uint64_t inserts = 0;
+    std::uint64_t insert_probes = 0;
+    std::uint64_t max_insert_probes = 0;
+    // inserts whose hash address was taken, so the element went to a collision slot
+    std::uint64_t collision_inserts = 0;
+    std::uint64_t rehashes = 0;
+    // rehashes under a new seed of the hash function, which count as rehashes too
+    std::uint64_t reseeds = 0;
+    // allocating new tables and migrating elements, incremental steps included
+    std::chrono::nanoseconds rehash_time{0};
+    // slots the free slot cursor moved down while looking for a collision slot
+    std::uint64_t free_slot_scans = 0;
+    std::uint64_t free_slot_scan_distance = 0;
+
+    void record_find(std::size_t probes) {
+        ++finds;
+        find_probes += probes;
+        max_find_probes = probes > max_find_probes ? probes : max_find_probes;
+    }
+
+    void record_insert(std::size_t probes) {
+        ++inserts;
+        insert_probes += probes;
+        max_insert_probes = probes > max_insert_probes ? probes : max_insert_probes;
+    }
+
+    void record_collision() {
+        ++collision_inserts;
+    }
+
+    void record_rehash() {
+        ++rehashes;
+    }
+
+    void record_rehash_time(std::chrono::nanoseconds time) {
+        rehash_time += time;
+    }
+
+    void record_reseed() {
+        ++reseeds;
+    }
+
+    void record_free_slot_scan(std::size_t distance) {
+        ++free_slot_scans;
+        free_slot_scan_distance += distance;
+    }
+
+    double average_find_probes() const {
+        return finds == 0 ? 0 : static_cast<double>(find_probes) / finds;
+    }
+
+    double average_insert_probes() const {
+        return inserts == 0 ? 0 : static_cast<double>(insert_probes) / inserts;
+    }
+};
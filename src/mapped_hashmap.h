@@ -0,0 +1,247 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "slot_layout.h"
+#include "slot_indexer.h"
+#include "snapshot.h"
+
+// A read-only map served straight from a snapshot file written by HashMap::save(). The file is mapped and its
+// arrays are used in place, so opening it costs only the header checks no matter how many elements it holds; pages
+// are read from disk as lookups touch them. The template parameters have to match those of the saved map, which the
+// header checks for everything but the equality of keys. Files whose bitmap marks slots past the end occupied are
+// refused, and lookups throw std::runtime_error on chains that leave the table or loop, which only a damaged file holds.
+template<class KeyType, class ValueType, class Hash = std::hash<KeyType>, class Layout = InterleavedLayout,
+        class IndexType = std::uint32_t, class Indexer = ModuloIndexer, class HashStorage = NoStoredHash>
+class MappedHashMap {
+    static_assert(std::is_trivially_copyable<KeyType>::value && std::is_trivially_copyable<ValueType>::value,
+                  "snapshots need trivially copyable keys and values");
+
+public:
+    using Table = typename Layout::template Table<KeyType, ValueType, IndexType, HashStorage,
+            std::allocator<std::pair<const KeyType, ValueType>>>;
+
+    explicit MappedHashMap(const std::string &path, Hash hash_function = Hash());
+
+    MappedHashMap(MappedHashMap &&other) = default;
+
+    MappedHashMap &operator=(MappedHashMap &&other) = default;
+
+    std::size_t size() const;
+
+    bool empty() const;
+
+    Hash hash_function() const;
+
+    std::size_t slot_count() const;
+
+    class const_iterator;
+
+    const_iterator begin() const;
+
+    const_iterator end() const;
+
+    const_iterator find(const KeyType &key) const;
+
+    const ValueType &at(const KeyType &key) const;
+
+private:
+    Hash hash_function_;
+    SnapshotMapping mapping_;
+    typename Table::View slots_;
+    std::size_t address_size_ = 0;
+    std::size_t size_ = 0;
+
+    static const IndexType NULL_INDEX = Table::NULL_INDEX;
+
+    IndexType find_index_(const KeyType &key) const;
+};
+
+// Writes the first table of a map, called by HashMap::save().
+template<class Table, class KeyType, class ValueType, class IndexType, class Indexer, class HashStorage, class Hash>
+void save_snapshot(const std::string &path, const Table &table, std::size_t address_size, std::size_t size,
+                   const Hash &hash_function) {
+    static_assert(std::is_trivially_copyable<KeyType>::value && std::is_trivially_copyable<ValueType>::value,
+                  "snapshots need trivially copyable keys and values");
+
+    SnapshotHeader header = snapshot_header<Table, KeyType, ValueType, IndexType, Indexer, HashStorage>(
+            table.size(), address_size, size, hash_function);
+    const void *arrays[SNAPSHOT_MAX_ARRAYS] = {};
+    table.snapshot_arrays(arrays);
+    write_snapshot(path, header, arrays);
+}
+
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer, class HashStorage>
+MappedHashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage>::MappedHashMap(const std::string &path,
+                                                                                               Hash hash_function)
+        : hash_function_(hash_function), mapping_(path) {
+    SnapshotHeader header;
+    if (mapping_.size() < sizeof(header)) {
+        throw std::runtime_error("snapshot " + path + " is truncated");
+    }
+    std::memcpy(&header, mapping_.data(), sizeof(header));
+    if (std::memcmp(header.magic, snapshot_magic(), sizeof(header.magic)) != 0) {
+        throw std::runtime_error(path + " is no snapshot");
+    }
+    if (header.byte_order != SNAPSHOT_BYTE_ORDER || header.version != SNAPSHOT_VERSION) {
+        throw std::runtime_error("snapshot " + path + " has an unsupported version or byte order");
+    }
+
+    SnapshotHeader expected = snapshot_header<Table, KeyType, ValueType, IndexType, Indexer, HashStorage>(
+            static_cast<std::size_t>(header.slot_count), static_cast<std::size_t>(header.address_size),
+            static_cast<std::size_t>(header.size), hash_function_);
+    if (header.layout != expected.layout || header.arrays_size != expected.arrays_size ||
+        header.key_bytes != expected.key_bytes || header.value_bytes != expected.value_bytes ||
+        header.index_bytes != expected.index_bytes || header.hash_bytes != expected.hash_bytes ||
+        header.slot_count > Table::NULL_INDEX || header.address_size > header.slot_count ||
+        header.size > header.slot_count) {
+        throw std::runtime_error("snapshot " + path + " holds a different map type");
+    }
+    if (header.hash_check != expected.hash_check || header.indexer_check != expected.indexer_check) {
+        throw std::runtime_error("snapshot " + path + " was saved with a different hash function or indexer");
+    }
+
+    const void *arrays[SNAPSHOT_MAX_ARRAYS] = {};
+    for (std::size_t k = 0; k < Table::SNAPSHOT_ARRAYS; ++k) {
+        if (header.bytes[k] != expected.bytes[k] || header.offsets[k] % SNAPSHOT_ALIGNMENT != 0 ||
+            header.offsets[k] > mapping_.size() || header.bytes[k] > mapping_.size() - header.offsets[k]) {
+            throw std::runtime_error("snapshot " + path + " is truncated");
+        }
+        arrays[k] = mapping_.data() + header.offsets[k];
+    }
+    slots_ = typename Table::View(arrays, static_cast<std::size_t>(header.slot_count));
+    if (!slots_.bitmap_ends_clear()) {
+        throw std::runtime_error("snapshot " + path + " marks slots past its end occupied");
+    }
+    address_size_ = static_cast<std::size_t>(header.address_size);
+    size_ = static_cast<std::size_t>(header.size);
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer, class HashStorage>
+std::size_t MappedHashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage>::size() const {
+    return size_;
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer, class HashStorage>
+bool MappedHashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage>::empty() const {
+    return size_ == 0;
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer, class HashStorage>
+Hash MappedHashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage>::hash_function() const {
+    return hash_function_;
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer, class HashStorage>
+std::size_t MappedHashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage>::slot_count() const {
+    return slots_.size();
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer, class HashStorage>
+typename MappedHashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage>::const_iterator
+MappedHashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage>::begin() const {
+    return const_iterator(slots_.next_occupied(0), this);
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer, class HashStorage>
+typename MappedHashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage>::const_iterator
+MappedHashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage>::end() const {
+    return const_iterator(slots_.size(), this);
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer, class HashStorage>
+typename MappedHashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage>::const_iterator
+MappedHashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage>::find(const KeyType &key) const {
+    IndexType i = find_index_(key);
+    if (i != NULL_INDEX) {
+        return const_iterator(i, this);
+    }
+    return end();
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer, class HashStorage>
+const ValueType &MappedHashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage>::at(const KeyType &key) const {
+    const_iterator it = find(key);
+    if (it != end()) {
+        return it->second;
+    }
+    throw std::out_of_range("");
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer, class HashStorage>
+IndexType MappedHashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage>::find_index_(const KeyType &key) const {
+    if (address_size_ == 0) {
+        return NULL_INDEX;
+    }
+
+    std::size_t hash = hash_function_(key);
+    IndexType i = static_cast<IndexType>(Indexer::index(hash, address_size_));
+    if (slots_.empty(i)) {
+        return NULL_INDEX;
+    }
+    // links come straight from the file, so a damaged one must neither lead out of the table nor around a cycle
+    std::size_t hops = 0;
+    while (!(slots_.hash_matches(i, hash) && slots_.key(i) == key)) {
+        i = slots_.link(i);
+        if (i == NULL_INDEX) {
+            return NULL_INDEX;
+        }
+        if (i >= slots_.size() || ++hops == slots_.size()) {
+            throw std::runtime_error("snapshot holds a damaged chain");
+        }
+    }
+    return i;
+}
+
+template<class KeyType, class ValueType, class Hash, class Layout, class IndexType, class Indexer, class HashStorage>
+class MappedHashMap<KeyType, ValueType, Hash, Layout, IndexType, Indexer, HashStorage>::const_iterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::pair<const KeyType, ValueType>;
+    using difference_type = std::ptrdiff_t;
+    using reference = typename Table::const_reference;
+    using pointer = typename Table::const_pointer;
+
+    const_iterator() = default;
+
+    const_iterator(std::size_t index, const MappedHashMap *map) : index_(index), map_(map) {}
+
+    const_iterator &operator++() {
+        index_ = map_->slots_.next_occupied(index_ + 1);
+        return *this;
+    }
+
+    const_iterator operator++(int) {
+        const_iterator ret_it = *this;
+        ++(*this);
+        return ret_it;
+    }
+
+    bool operator==(const const_iterator &other) const {
+        return index_ == other.index_ && map_ == other.map_;
+    }
+
+    bool operator!=(const const_iterator &other) const {
+        return !(*this == other);
+    }
+
+    reference operator*() const {
+        return map_->slots_.value(index_);
+    }
+
+    pointer operator->() const {
+        return map_->slots_.address(index_);
+    }
+
+private:
+    std::size_t index_ = 0;
+    const MappedHashMap *map_ = nullptr;
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+// Owns one element that extract() took out of a HashMap, until insert() moves it into the same or another map with
+// the same key and value types. Slots hold their elements in place, so the element is moved out of its slot and into
+// the next one rather than relinked as a node, but it is never copied. The key can be changed before inserting.
+template<class KeyType, class ValueType>
+class NodeHandle {
+public:
+    NodeHandle() = default;
+
+    NodeHandle(NodeHandle &&other) noexcept(std::is_nothrow_move_constructible<KeyType>::value &&
+                                            std::is_nothrow_move_constructible<ValueType>::value)
+            : element_(std::move(other.element_)) {
+        other.element_.reset();
+    }
+
+    NodeHandle &operator=(NodeHandle &&other) noexcept(std::is_nothrow_move_constructible<KeyType>::value &&
+                                                       std::is_nothrow_move_constructible<ValueType>::value) {
+        if (this != &other) {
+            element_.reset();
+            if (other.element_) {
+                element_.emplace(std::move(other.element_->first), std::move(other.element_->second));
+                other.element_.reset();
+            }
+        }
+        return *this;
+    }
+
+    bool empty() const {
+        return !element_;
+    }
+
+    explicit operator bool() const {
+        return !empty();
+    }
+
+    KeyType &key() {
+        return element_->first;
+    }
+
+    const KeyType &key() const {
+        return element_->first;
+    }
+
+    ValueType &mapped() {
+        return element_->second;
+    }
+
+    const ValueType &mapped() const {
+        return element_->second;
+    }
+
+private:
+    template<class, class, class, class, class, class, class, class, class>
+    friend class HashMap;
+
+    // keeps braced pairs passed to insert() from converting to nodes
+    struct FromMap {
+    };
+
+    std::optional<std::pair<KeyType, ValueType>> element_;
+
+    NodeHandle(FromMap, KeyType &&key, ValueType &&value)
+            : element_(std::in_place, std::move(key), std::move(value)) {}
+
+    void reset() {
+        element_.reset();
+    }
+};
+
+// What inserting a node returns: where the key is, whether the node was inserted and, if the key was already there,
+// the node itself.
+template<class Iterator, class Node>
+struct NodeInsertResult {
+    Iterator position;
+    bool inserted;
+    Node node;
+};
@@ -0,0 +1,460 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "slot_bitmap.h"
+#include "slot_layout.h"
+
+// Keeps the slots in pages of PageSlots slots, each with a reference count, and shares the pages between copies of a
+// table. A copy costs one reference per page plus its own occupancy bitmap, and a table clones a page the first time
+// it writes to it while another table still refers to it, so copies and snapshots of a map only cost the memory of the
+// pages written since. Any non-const access to an element counts as a write; erasing from a shared page and moving
+// elements out of it during a rehash don't, those only change the bitmap of the table. Keys and values must be copy
+// constructible, and snapshot files (HashMap::save) don't support this layout.
+//
+// Tables sharing pages may live on different threads: the reference counts are atomic, and a page is written only by
+// the one table that holds the sole reference to it.
+template<std::size_t PageSlots = 1024>
+struct PagedLayout {
+    static_assert(PageSlots >= BITMAP_WORD_BITS && (PageSlots & (PageSlots - 1)) == 0,
+                  "PageSlots must be a power of two of at least 64");
+
+    template<class KeyType, class ValueType, class IndexType, class HashStorage, class Allocator>
+    class Table;
+};
+
+
+template<std::size_t PageSlots>
+template<class KeyType, class ValueType, class IndexType, class HashStorage, class Allocator>
+class PagedLayout<PageSlots>::Table : public TableAllocator<Allocator> {
+public:
+    using reference = std::pair<const KeyType, ValueType> &;
+    using const_reference = const std::pair<const KeyType, ValueType> &;
+    using pointer = std::pair<const KeyType, ValueType> *;
+    using const_pointer = const std::pair<const KeyType, ValueType> *;
+
+    static constexpr IndexType NULL_INDEX = std::numeric_limits<IndexType>::max();
+
+    static constexpr bool COPY_ON_WRITE = true;
+
+    Table() = default;
+
+    explicit Table(const Allocator &allocator) : TableAllocator<Allocator>(allocator) {}
+
+    Table(const Table &other)
+            : Table(other, std::allocator_traits<Allocator>::select_on_container_copy_construction(other.allocator_)) {}
+
+    // shares the pages of other, or clones them all if they were allocated by an unequal allocator
+    Table(const Table &other, const Allocator &allocator) : TableAllocator<Allocator>(allocator) {
+        allocate_(other.size_);
+        std::copy(other.occupied_, other.occupied_ + occupied_words_(size_), occupied_);
+        std::copy(other.stale_, other.stale_ + bitmap_words(page_count_(size_)), stale_);
+        std::size_t p = 0;
+        try {
+            for (; p < page_count_(size_); ++p) {
+                pages_[p] = share_page_(other, p);
+            }
+        } catch (...) {
+            release_pages_(p);
+            deallocate_();
+            throw;
+        }
+    }
+
+    Table(Table &&other) noexcept : TableAllocator<Allocator>(other) {
+        take_storage_(other);
+    }
+
+    Table(Table &&other, const Allocator &allocator) : Table(static_cast<const Table &>(other), allocator) {
+        other.clear();
+    }
+
+    Table &operator=(const Table &other) {
+        if (this != &other) {
+            Table copy(other, this->copy_assignment_allocator_(other));
+            clear();
+            this->propagate_on_copy_assignment_(other);
+            take_storage_(copy);
+        }
+        return *this;
+    }
+
+    Table &operator=(Table &&other) noexcept(TableAllocator<Allocator>::NOTHROW_MOVE_ASSIGNMENT) {
+        if (this == &other) {
+            return *this;
+        }
+        if (this->can_take_storage_(other)) {
+            clear();
+            this->propagate_on_move_assignment_(other);
+            take_storage_(other);
+        } else {
+            Table moved(std::move(other), this->allocator_);
+            clear();
+            take_storage_(moved);
+        }
+        return *this;
+    }
+
+    ~Table() {
+        clear();
+    }
+
+    std::size_t size() const {
+        return size_;
+    }
+
+    // empty slots only get their metadata initialized
+    void assign(std::size_t slots_size) {
+        clear();
+        allocate_(slots_size);
+        std::size_t p = 0;
+        try {
+            for (; p < page_count_(size_); ++p) {
+                pages_[p] = new_page_();
+            }
+        } catch (...) {
+            release_pages_(p);
+            deallocate_();
+            throw;
+        }
+    }
+
+    void clear() {
+        release_pages_(page_count_(size_));
+        deallocate_();
+    }
+
+    void swap(Table &other) noexcept {
+        this->swap_allocator_(other);
+        std::swap(pages_, other.pages_);
+        std::swap(occupied_, other.occupied_);
+        std::swap(stale_, other.stale_);
+        std::swap(size_, other.size_);
+    }
+
+    // clones every page that another table refers to, after which writes never clone
+    void unshare() {
+        for (std::size_t p = 0; p < page_count_(size_); ++p) {
+            writable_page_(p);
+        }
+    }
+
+    bool empty(std::size_t i) const {
+        return !test_bit(occupied_, i);
+    }
+
+    IndexType link(std::size_t i) const {
+        return slot_(i).link;
+    }
+
+    void set_link(std::size_t i, IndexType link) {
+        writable_slot_(i).link = link;
+    }
+
+    const KeyType &key(std::size_t i) const {
+        return slot_(i).value.get()->first;
+    }
+
+    ValueType &mapped(std::size_t i) {
+        return writable_slot_(i).value.get()->second;
+    }
+
+    reference value(std::size_t i) {
+        return *writable_slot_(i).value.get();
+    }
+
+    const_reference value(std::size_t i) const {
+        return *slot_(i).value.get();
+    }
+
+    pointer address(std::size_t i) {
+        return writable_slot_(i).value.get();
+    }
+
+    const_pointer address(std::size_t i) const {
+        return slot_(i).value.get();
+    }
+
+    // constructs the element of a free slot from the arguments of a std::pair constructor
+    template<class... Args>
+    void construct(std::size_t i, std::size_t hash, Args &&... args) {
+        Page &page = writable_page_(i / PageSlots);
+        Slot &slot = page.slots[i % PageSlots];
+        slot.value.construct(this->allocator_, std::forward<Args>(args)...);
+        if constexpr (HashStorage::ENABLED) {
+            slot.hash = static_cast<typename HashStorage::hash_type>(hash);
+        }
+        set_bit(page.constructed, i % PageSlots);
+        set_bit(occupied_, i);
+    }
+
+    // moves the element in slot j of from into the free slot i and frees slot j, keeping both links
+    void relocate(std::size_t i, Table &from, std::size_t j) {
+        relocate_element(i, from, j);
+        clear_bit(from.occupied_, j);
+    }
+
+    // like relocate, but slot j stays marked occupied; from has to forget_elements() once all of them are moved out.
+    // An element on a page that another table shares is copied and stays there for that table, so migrating a table
+    // that a snapshot shares never clones its pages.
+    void relocate_element(std::size_t i, Table &from, std::size_t j) {
+        Page &page = writable_page_(i / PageSlots);
+        Page &source_page = *from.pages_[j / PageSlots];
+        Slot &slot = page.slots[i % PageSlots];
+        Slot &source = source_page.slots[j % PageSlots];
+        if (source_page.references.load(std::memory_order_acquire) != 1) {
+            slot.value.construct(this->allocator_, *source.value.get());
+            set_bit(from.stale_, j / PageSlots);
+        } else {
+            if constexpr (std::is_trivially_copyable<KeyType>::value &&
+                          std::is_trivially_copyable<ValueType>::value) {
+                std::memcpy(static_cast<void *>(&slot.value), &source.value, sizeof(slot.value));
+            } else {
+                std::pair<const KeyType, ValueType> &value = *source.value.get();
+                // the source is destroyed right away, so its key may be moved from despite being const
+                slot.value.construct(this->allocator_, std::move(const_cast<KeyType &>(value.first)),
+                                     std::move(value.second));
+                source.value.destroy(from.allocator_);
+            }
+            clear_bit(source_page.constructed, j % PageSlots);
+        }
+        static_cast<typename HashStorage::Field &>(slot) = source;
+        set_bit(page.constructed, i % PageSlots);
+        set_bit(occupied_, i);
+    }
+
+    // marks every slot free without destroying anything, after relocate_element() moved out all elements; shared
+    // pages are left as they are for the tables that share them
+    void forget_elements() {
+        std::fill(occupied_, occupied_ + occupied_words_(size_), 0);
+        std::fill(stale_, stale_ + bitmap_words(page_count_(size_)), ~std::uint64_t(0));
+    }
+
+    std::size_t hash(std::size_t i) const {
+        if constexpr (HashStorage::ENABLED) {
+            return slot_(i).hash;
+        } else {
+            return 0;
+        }
+    }
+
+    // replaces the stored hash code of an occupied slot, a no-op without stored hash codes
+    void set_hash(std::size_t i, std::size_t hash) {
+        if constexpr (HashStorage::ENABLED) {
+            writable_slot_(i).hash = static_cast<typename HashStorage::hash_type>(hash);
+        }
+    }
+
+    bool hash_matches(std::size_t i, std::size_t hash) const {
+        if constexpr (HashStorage::ENABLED) {
+            return slot_(i).hash == static_cast<typename HashStorage::hash_type>(hash);
+        } else {
+            return true;
+        }
+    }
+
+    // destroys the element but keeps the link, so chains passing through the slot stay walkable. On a shared page the
+    // element only leaves this table, the tables that share it keep it.
+    void destroy(std::size_t i) {
+        Page &page = *pages_[i / PageSlots];
+        if (page.references.load(std::memory_order_acquire) != 1) {
+            set_bit(stale_, i / PageSlots);
+        } else {
+            page.slots[i % PageSlots].value.destroy(this->allocator_);
+            clear_bit(page.constructed, i % PageSlots);
+        }
+        clear_bit(occupied_, i);
+    }
+
+    void init_empty(std::size_t i) {
+        if (!empty(i)) {
+            destroy(i);
+        }
+        if (link(i) != NULL_INDEX) {
+            set_link(i, NULL_INDEX);
+        }
+    }
+
+    // loads the cache lines that a chain walk reads at slot i
+    void prefetch(std::size_t i) const {
+        prefetch_read(pages_[i / PageSlots]->slots + i % PageSlots);
+        prefetch_read(occupied_ + i / BITMAP_WORD_BITS);
+    }
+
+    std::size_t next_occupied(std::size_t i) const {
+        return find_next_set(occupied_, size_, i);
+    }
+
+    // the largest free slot at or below i, or size() if there is none
+    std::size_t prev_free(std::size_t i) const {
+        return find_prev_clear(occupied_, size_, i);
+    }
+
+private:
+    static constexpr std::size_t PAGE_WORDS = PageSlots / BITMAP_WORD_BITS;
+
+    struct Slot : HashStorage::Field {
+        RawStorage<std::pair<const KeyType, ValueType>> value;
+        IndexType link = NULL_INDEX;
+    };
+
+    // constructed marks the elements the page holds, for all tables that share it; slots past the end of the table
+    // in the last page stay empty
+    struct Page {
+        std::atomic<std::size_t> references;
+        std::uint64_t constructed[PAGE_WORDS];
+        Slot slots[PageSlots];
+    };
+
+    Page **pages_ = nullptr;
+    // the occupied slots of this table, a subset of the constructed ones of its pages
+    std::uint64_t *occupied_ = nullptr;
+    // pages that may hold elements this table erased or moved out while the page was shared; such elements are
+    // destroyed once this table writes to the page as its only holder
+    std::uint64_t *stale_ = nullptr;
+    std::size_t size_ = 0;
+
+    static std::size_t page_count_(std::size_t slots_size) {
+        return (slots_size + PageSlots - 1) / PageSlots;
+    }
+
+    // the occupancy bitmap covers whole pages
+    static std::size_t occupied_words_(std::size_t slots_size) {
+        return page_count_(slots_size) * PAGE_WORDS;
+    }
+
+    const Slot &slot_(std::size_t i) const {
+        return pages_[i / PageSlots]->slots[i % PageSlots];
+    }
+
+    Slot &writable_slot_(std::size_t i) {
+        return writable_page_(i / PageSlots).slots[i % PageSlots];
+    }
+
+    // the page, cloned first if another table refers to it too
+    Page &writable_page_(std::size_t p) {
+        Page *page = pages_[p];
+        // acquire, so the reads of a table that dropped its reference happen before the writes
+        if (page->references.load(std::memory_order_acquire) != 1) {
+            pages_[p] = clone_page_(*page, occupied_ + p * PAGE_WORDS);
+            release_page_(page);
+            clear_bit(stale_, p);
+        } else if (test_bit(stale_, p)) {
+            destroy_unoccupied_(*page, occupied_ + p * PAGE_WORDS);
+            clear_bit(stale_, p);
+        }
+        return *pages_[p];
+    }
+
+    // allocates page pointers and bitmaps for slots_size slots, with all slots free
+    void allocate_(std::size_t slots_size) {
+        pages_ = allocate_array<Page *>(this->allocator_, page_count_(slots_size));
+        try {
+            occupied_ = allocate_array<std::uint64_t>(this->allocator_, occupied_words_(slots_size));
+            stale_ = allocate_array<std::uint64_t>(this->allocator_, bitmap_words(page_count_(slots_size)));
+        } catch (...) {
+            deallocate_array(this->allocator_, pages_, page_count_(slots_size));
+            deallocate_array(this->allocator_, occupied_, occupied_words_(slots_size));
+            pages_ = nullptr;
+            occupied_ = nullptr;
+            throw;
+        }
+        std::fill(occupied_, occupied_ + occupied_words_(slots_size), 0);
+        std::fill(stale_, stale_ + bitmap_words(page_count_(slots_size)), 0);
+        size_ = slots_size;
+    }
+
+    // frees what allocate_() allocated, after the pages are released
+    void deallocate_() {
+        deallocate_array(this->allocator_, pages_, page_count_(size_));
+        deallocate_array(this->allocator_, occupied_, occupied_words_(size_));
+        deallocate_array(this->allocator_, stale_, bitmap_words(page_count_(size_)));
+        pages_ = nullptr;
+        occupied_ = nullptr;
+        stale_ = nullptr;
+        size_ = 0;
+    }
+
+    Page *new_page_() {
+        Page *page = allocate_array<Page>(this->allocator_, 1);
+        page->references.store(1, std::memory_order_relaxed);
+        std::fill(page->constructed, page->constructed + PAGE_WORDS, 0);
+        return page;
+    }
+
+    // copies the metadata of every slot and the elements that occupied marks
+    Page *clone_page_(const Page &source, const std::uint64_t *occupied) {
+        Page *page = new_page_();
+        try {
+            for (std::size_t i = 0; i < PageSlots; ++i) {
+                static_cast<typename HashStorage::Field &>(page->slots[i]) = source.slots[i];
+                page->slots[i].link = source.slots[i].link;
+                if (test_bit(occupied, i)) {
+                    page->slots[i].value.construct(this->allocator_, *source.slots[i].value.get());
+                    set_bit(page->constructed, i);
+                }
+            }
+        } catch (...) {
+            release_page_(page);
+            throw;
+        }
+        return page;
+    }
+
+    Page *share_page_(const Table &other, std::size_t p) {
+        Page *page = other.pages_[p];
+        if (std::allocator_traits<Allocator>::is_always_equal::value || this->allocator_ == other.allocator_) {
+            page->references.fetch_add(1, std::memory_order_relaxed);
+            return page;
+        }
+        clear_bit(stale_, p);
+        return clone_page_(*page, occupied_ + p * PAGE_WORDS);
+    }
+
+    void destroy_unoccupied_(Page &page, const std::uint64_t *occupied) {
+        for (std::size_t w = 0; w < PAGE_WORDS; ++w) {
+            for (std::uint64_t word = page.constructed[w] & ~occupied[w]; word != 0; word &= word - 1) {
+                page.slots[w * BITMAP_WORD_BITS + count_trailing_zeros(word)].value.destroy(this->allocator_);
+            }
+            page.constructed[w] &= occupied[w];
+        }
+    }
+
+    void release_page_(Page *page) {
+        // acq_rel, so the last table to drop a page destroys it after every other one is done with it
+        if (page->references.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+            return;
+        }
+        for (std::size_t i = find_next_set(page->constructed, PageSlots, 0); i < PageSlots;
+             i = find_next_set(page->constructed, PageSlots, i + 1)) {
+            page->slots[i].value.destroy(this->allocator_);
+        }
+        deallocate_array(this->allocator_, page, 1);
+    }
+
+    // releases the first count pages
+    void release_pages_(std::size_t count) {
+        for (std::size_t p = 0; p < count; ++p) {
+            release_page_(pages_[p]);
+        }
+    }
+
+    void take_storage_(Table &other) noexcept {
+        pages_ = other.pages_;
+        occupied_ = other.occupied_;
+        stale_ = other.stale_;
+        size_ = other.size_;
+        other.pages_ = nullptr;
+        other.occupied_ = nullptr;
+        other.stale_ = nullptr;
+        other.size_ = 0;
+    }
+};
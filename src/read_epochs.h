@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+
+// Grace periods for memory that lock-free readers may still be looking at. Readers announce themselves in one of a
+// fixed number of padded counters picked per thread, so they only write a cache line shared with few other threads.
+// A writer that has unpublished a pointer calls synchronize(), which returns once every reader that could have
+// loaded it has left, so the memory can be freed.
+class ReadEpochs {
+public:
+    class Guard {
+    public:
+        explicit Guard(const ReadEpochs &epochs) : counter_(&epochs.enter_()) {}
+
+        Guard(const Guard &) = delete;
+
+        Guard &operator=(const Guard &) = delete;
+
+        ~Guard() {
+            counter_->fetch_sub(1, std::memory_order_release);
+        }
+
+    private:
+        std::atomic<std::size_t> *counter_;
+    };
+
+    // there must be at most one synchronizing thread at a time
+    void synchronize() {
+        std::size_t epoch = epoch_.load(std::memory_order_relaxed);
+        epoch_.store(epoch + 1, std::memory_order_seq_cst);
+        // readers entering from now on count under the other parity and see everything published before
+        for (Counters &counters : counters_) {
+            while (counters.readers[epoch & 1].load(std::memory_order_acquire) != 0) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+private:
+    static constexpr std::size_t COUNTERS_SIZE = 64;
+
+    struct alignas(64) Counters {
+        std::atomic<std::size_t> readers[2] = {};
+    };
+
+    std::atomic<std::size_t> epoch_{0};
+    mutable Counters counters_[COUNTERS_SIZE];
+
+    static std::size_t thread_counters_() {
+        static std::atomic<std::size_t> next_thread{0};
+        thread_local std::size_t index = next_thread.fetch_add(1, std::memory_order_relaxed) % COUNTERS_SIZE;
+        return index;
+    }
+
+    std::atomic<std::size_t> &enter_() const {
+        Counters &counters = counters_[thread_counters_()];
+        while (true) {
+            std::size_t epoch = epoch_.load(std::memory_order_seq_cst);
+            std::atomic<std::size_t> &counter = counters.readers[epoch & 1];
+            counter.fetch_add(1, std::memory_order_seq_cst);
+            // a synchronize() that flipped the epoch in between may have checked this counter already
+            if (epoch_.load(std::memory_order_seq_cst) == epoch) {
+                return counter;
+            }
+            counter.fetch_sub(1, std::memory_order_release);
+        }
+    }
+};
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+// Hashing keyed by a secret seed, for maps whose keys come from untrusted input. Without the seed an attacker can't
+// pick keys that share a hash address, so chains stay short no matter which keys arrive. The mixing follows wyhash:
+// the 64-bit halves of a 128-bit product of key and seed material are folded together.
+
+namespace seeded_hash_detail {
+    constexpr std::uint64_t SECRET[4] = {0xa0761d6478bd642fULL, 0xe7037ed1a0b428dbULL, 0x8ebc6af09c88c6e3ULL,
+                                         0x589965cc75374cc3ULL};
+
+    // multiplies to 128 bits and folds the halves together
+    inline std::uint64_t mum(std::uint64_t a, std::uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+        unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+        return static_cast<std::uint64_t>(product) ^ static_cast<std::uint64_t>(product >> 64);
+#else
+        std::uint64_t a_high = a >> 32, a_low = static_cast<std::uint32_t>(a);
+        std::uint64_t b_high = b >> 32, b_low = static_cast<std::uint32_t>(b);
+        std::uint64_t low_product = a_low * b_low;
+        std::uint64_t middle = a_high * b_low + (low_product >> 32);
+        std::uint64_t middle2 = static_cast<std::uint32_t>(middle) + a_low * b_high;
+        std::uint64_t high = a_high * b_high + (middle >> 32) + (middle2 >> 32);
+        return (a * b) ^ high;
+#endif
+    }
+
+    inline std::uint64_t read64(const unsigned char *bytes) {
+        std::uint64_t value;
+        std::memcpy(&value, bytes, sizeof(value));
+        return value;
+    }
+
+    inline std::uint64_t read32(const unsigned char *bytes) {
+        std::uint32_t value;
+        std::memcpy(&value, bytes, sizeof(value));
+        return value;
+    }
+
+    inline std::uint64_t hash_bytes(const void *data, std::size_t size, std::uint64_t seed) {
+        const unsigned char *bytes = static_cast<const unsigned char *>(data);
+        seed ^= mum(seed ^ SECRET[0], SECRET[1]);
+        std::uint64_t a = 0, b = 0;
+        if (size <= 16) {
+            if (size >= 4) {
+                a = (read32(bytes) << 32) | read32(bytes + ((size >> 3) << 2));
+                b = (read32(bytes + size - 4) << 32) | read32(bytes + size - 4 - ((size >> 3) << 2));
+            } else if (size > 0) {
+                a = (static_cast<std::uint64_t>(bytes[0]) << 16) | (static_cast<std::uint64_t>(bytes[size >> 1]) << 8) |
+                    bytes[size - 1];
+            }
+        } else {
+            std::size_t rest = size;
+            for (; rest > 16; rest -= 16, bytes += 16) {
+                seed = mum(read64(bytes) ^ SECRET[1], read64(bytes + 8) ^ seed);
+            }
+            a = read64(bytes + rest - 16);
+            b = read64(bytes + rest - 8);
+        }
+        return mum(SECRET[1] ^ size, mum(a ^ SECRET[1], b ^ seed));
+    }
+
+    inline std::uint64_t hash_integer(std::uint64_t key, std::uint64_t seed) {
+        return mum(mum(key ^ seed ^ SECRET[0], seed ^ SECRET[1]), SECRET[2]);
+    }
+} // namespace seeded_hash_detail
+
+// A seed that differs between calls and between runs. Seeds of one process come from one std::random_device draw
+// and a counter, so taking one is cheap.
+inline std::uint64_t random_seed() {
+    static const std::uint64_t base = [] {
+        std::random_device device;
+        std::uint64_t time = static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+        return (static_cast<std::uint64_t>(device()) << 32 ^ device()) ^ time;
+    }();
+    static std::atomic<std::uint64_t> counter{0};
+    return seeded_hash_detail::hash_integer(counter.fetch_add(1, std::memory_order_relaxed), base);
+}
+
+// Hashes integers and enums with two multiplications, anything convertible to std::string_view byte by byte, and
+// other keys by mixing their std::hash code with the seed. The last only spreads keys with distinct std::hash codes,
+// keys whose std::hash codes are equal keep colliding under every seed. Every instance draws its own seed.
+template<class T>
+class SeededHash {
+public:
+    SeededHash() : seed_(random_seed()) {}
+
+    explicit SeededHash(std::uint64_t seed) : seed_(seed) {}
+
+    std::size_t operator()(const T &key) const {
+        if constexpr (std::is_integral<T>::value || std::is_enum<T>::value) {
+            return static_cast<std::size_t>(seeded_hash_detail::hash_integer(static_cast<std::uint64_t>(key), seed_));
+        } else if constexpr (std::is_convertible<const T &, std::string_view>::value) {
+            std::string_view bytes = key;
+            return static_cast<std::size_t>(seeded_hash_detail::hash_bytes(bytes.data(), bytes.size(), seed_));
+        } else {
+            return static_cast<std::size_t>(seeded_hash_detail::hash_integer(std::hash<T>()(key), seed_));
+        }
+    }
+
+    std::uint64_t seed() const {
+        return seed_;
+    }
+
+    // draws a new seed, after which every key hashes differently
+    void reseed() {
+        seed_ = random_seed();
+    }
+
+private:
+    std::uint64_t seed_;
+};
+
+// Whether Hash can draw a new seed with reseed(), which lets HashMap rehash under a new seed when chains get long.
+template<class Hash, class = void>
+struct is_reseedable : std::false_type {
+};
+
+template<class Hash>
+struct is_reseedable<Hash, std::void_t<decltype(std::declval<Hash &>().reseed())>> : std::true_type {
+};
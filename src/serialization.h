@@ -0,0 +1,575 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <iterator>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Streams of map elements in chunks of bounded size. Elements are encoded by Codec<T>, which knows arithmetic and
+// other trivially copyable types, std::string, std::pair and std::vector, and can be specialized for other types.
+// Every chunk can be compressed and carries a CRC-32 of its bytes, so streams can be shipped between machines. All
+// counts, integers, enums, floats and doubles are stored little-endian; other trivially copyable types, structs and
+// long double included, are copied in host byte order and layout.
+//
+// Stream: "CHMSTRM" magic, version, flags, element count, then chunks of
+// element count, encoded size, stored size, compressed flag, checksum and the stored bytes.
+// A chunk without elements ends the stream.
+
+constexpr std::uint32_t STREAM_VERSION = 1;
+constexpr std::uint32_t STREAM_CHECKSUMS = 1;
+
+struct SerializeOptions {
+    // chunks are flushed once their encoded elements exceed this many bytes
+    std::size_t chunk_bytes = std::size_t(1) << 16;
+    bool compress = false;
+    bool checksums = true;
+};
+
+// Reads bytes from an encoded chunk and throws on reading past its end.
+class ByteReader {
+public:
+    ByteReader(const char *data, std::size_t size) : data_(data), end_(data + size) {}
+
+    void read(void *to, std::size_t n) {
+        if (static_cast<std::size_t>(end_ - data_) < n) {
+            throw std::runtime_error("truncated element in stream");
+        }
+        std::memcpy(to, data_, n);
+        data_ += n;
+    }
+
+    const char *take(std::size_t n) {
+        if (static_cast<std::size_t>(end_ - data_) < n) {
+            throw std::runtime_error("truncated element in stream");
+        }
+        const char *data = data_;
+        data_ += n;
+        return data;
+    }
+
+    bool done() const {
+        return data_ == end_;
+    }
+
+    const char *data() const {
+        return data_;
+    }
+
+private:
+    const char *data_;
+    const char *end_;
+};
+
+inline void encode_uint(std::uint64_t value, std::size_t bytes, std::string &out) {
+    for (std::size_t k = 0; k < bytes; ++k) {
+        out.push_back(static_cast<char>(value >> (8 * k) & 0xFF));
+    }
+}
+
+inline std::uint64_t decode_uint(const unsigned char *data, std::size_t bytes) {
+    std::uint64_t value = 0;
+    for (std::size_t k = 0; k < bytes; ++k) {
+        value |= static_cast<std::uint64_t>(data[k]) << (8 * k);
+    }
+    return value;
+}
+
+// LEB128, seven bits per byte
+inline void encode_varint(std::uint64_t value, std::string &out) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+inline std::uint64_t decode_varint(ByteReader &in) {
+    std::uint64_t value = 0;
+    for (std::size_t shift = 0; shift < 64; shift += 7) {
+        unsigned char byte;
+        in.read(&byte, 1);
+        value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return value;
+        }
+    }
+    throw std::runtime_error("malformed length in stream");
+}
+
+// floating point types that Codec stores little-endian through their bits
+template<class T>
+constexpr bool is_portable_float = std::is_floating_point<T>::value && (sizeof(T) == 4 || sizeof(T) == 8);
+
+template<class T>
+struct Codec {
+    static_assert(std::is_trivially_copyable<T>::value, "specialize Codec for this type");
+
+    static void encode(const T &value, std::string &out) {
+        if constexpr (std::is_integral<T>::value || std::is_enum<T>::value) {
+            encode_uint(static_cast<std::uint64_t>(value), sizeof(T), out);
+        } else if constexpr (is_portable_float<T>) {
+            typename std::conditional<sizeof(T) == 4, std::uint32_t, std::uint64_t>::type bits;
+            std::memcpy(&bits, &value, sizeof(T));
+            encode_uint(bits, sizeof(T), out);
+        } else {
+            out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+        }
+    }
+
+    static T decode(ByteReader &in) {
+        T value;
+        if constexpr (std::is_integral<T>::value || std::is_enum<T>::value) {
+            const char *data = in.take(sizeof(T));
+            value = static_cast<T>(decode_uint(reinterpret_cast<const unsigned char *>(data), sizeof(T)));
+        } else if constexpr (is_portable_float<T>) {
+            const char *data = in.take(sizeof(T));
+            auto bits = static_cast<typename std::conditional<sizeof(T) == 4, std::uint32_t, std::uint64_t>::type>(
+                    decode_uint(reinterpret_cast<const unsigned char *>(data), sizeof(T)));
+            std::memcpy(&value, &bits, sizeof(T));
+        } else {
+            in.read(&value, sizeof(T));
+        }
+        return value;
+    }
+};
+
+template<>
+struct Codec<std::string> {
+    static void encode(const std::string &value, std::string &out) {
+        encode_varint(value.size(), out);
+        out.append(value);
+    }
+
+    static std::string decode(ByteReader &in) {
+        std::size_t size = static_cast<std::size_t>(decode_varint(in));
+        return std::string(in.take(size), size);
+    }
+};
+
+template<class First, class Second>
+struct Codec<std::pair<First, Second>> {
+    static void encode(const std::pair<First, Second> &value, std::string &out) {
+        Codec<First>::encode(value.first, out);
+        Codec<Second>::encode(value.second, out);
+    }
+
+    static std::pair<First, Second> decode(ByteReader &in) {
+        First first = Codec<First>::decode(in);
+        Second second = Codec<Second>::decode(in);
+        return std::pair<First, Second>(std::move(first), std::move(second));
+    }
+};
+
+template<class T, class Allocator>
+struct Codec<std::vector<T, Allocator>> {
+    static void encode(const std::vector<T, Allocator> &value, std::string &out) {
+        encode_varint(value.size(), out);
+        for (const T &element : value) {
+            Codec<T>::encode(element, out);
+        }
+    }
+
+    static std::vector<T, Allocator> decode(ByteReader &in) {
+        std::size_t size = static_cast<std::size_t>(decode_varint(in));
+        std::vector<T, Allocator> value;
+        for (std::size_t k = 0; k < size; ++k) {
+            value.push_back(Codec<T>::decode(in));
+        }
+        return value;
+    }
+};
+
+// CRC-32 with the reflected polynomial 0xEDB88320, as used by zlib
+inline std::uint32_t crc32(const char *data, std::size_t size) {
+    static const std::vector<std::uint32_t> table = [] {
+        std::vector<std::uint32_t> table(256);
+        for (std::uint32_t k = 0; k < 256; ++k) {
+            std::uint32_t crc = k;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = crc & 1 ? 0xEDB88320 ^ crc >> 1 : crc >> 1;
+            }
+            table[k] = crc;
+        }
+        return table;
+    }();
+
+    std::uint32_t crc = 0xFFFFFFFF;
+    for (std::size_t k = 0; k < size; ++k) {
+        crc = table[(crc ^ static_cast<unsigned char>(data[k])) & 0xFF] ^ crc >> 8;
+    }
+    return crc ^ 0xFFFFFFFF;
+}
+
+// LZ77 in the style of LZ4: sequences of a token with 4-bit literal and match lengths (15 continues in bytes of 255),
+// the literals, a 16-bit offset and the rest of the match length. The last sequence has literals only.
+constexpr std::size_t LZ_MIN_MATCH = 4;
+constexpr std::size_t LZ_MAX_OFFSET = 65535;
+constexpr std::size_t LZ_HASH_BITS = 12;
+
+inline void lz_encode_length(std::size_t length, std::string &out) {
+    for (; length >= 255; length -= 255) {
+        out.push_back(static_cast<char>(255));
+    }
+    out.push_back(static_cast<char>(length));
+}
+
+inline std::string lz_compress(const std::string &in) {
+    std::string out;
+    std::size_t size = in.size();
+    std::vector<std::size_t> table(std::size_t(1) << LZ_HASH_BITS, static_cast<std::size_t>(-1));
+    auto read32 = [&in](std::size_t i) {
+        std::uint32_t word;
+        std::memcpy(&word, in.data() + i, sizeof(word));
+        return word;
+    };
+    auto emit = [&](std::size_t literals_begin, std::size_t literals_end, std::size_t offset, std::size_t match) {
+        std::size_t literals = literals_end - literals_begin;
+        std::size_t extra = match == 0 ? 0 : match - LZ_MIN_MATCH;
+        out.push_back(static_cast<char>(std::min<std::size_t>(literals, 15) << 4 | std::min<std::size_t>(extra, 15)));
+        if (literals >= 15) {
+            lz_encode_length(literals - 15, out);
+        }
+        out.append(in, literals_begin, literals);
+        if (match != 0) {
+            encode_uint(offset, 2, out);
+            if (extra >= 15) {
+                lz_encode_length(extra - 15, out);
+            }
+        }
+    };
+
+    std::size_t anchor = 0;
+    std::size_t i = 0;
+    while (i + LZ_MIN_MATCH <= size) {
+        std::size_t slot = static_cast<std::uint32_t>(read32(i) * 2654435761U) >> (32 - LZ_HASH_BITS);
+        std::size_t candidate = table[slot];
+        table[slot] = i;
+        if (candidate != static_cast<std::size_t>(-1) && i - candidate <= LZ_MAX_OFFSET &&
+            read32(candidate) == read32(i)) {
+            std::size_t match = LZ_MIN_MATCH;
+            while (i + match < size && in[candidate + match] == in[i + match]) {
+                ++match;
+            }
+            emit(anchor, i, i - candidate, match);
+            i += match;
+            anchor = i;
+        } else {
+            ++i;
+        }
+    }
+    if (anchor < size || size == 0) {
+        emit(anchor, size, 0, 0);
+    }
+    return out;
+}
+
+inline std::string lz_decompress(const char *data, std::size_t size, std::size_t raw_size) {
+    std::string out;
+    // no token expands to more than about 255 times its size, a damaged raw_size mustn't reserve more
+    out.reserve(std::min(raw_size, size * 256));
+    ByteReader in(data, size);
+    auto decode_length = [&in](std::size_t length) {
+        if (length == 15) {
+            unsigned char byte;
+            do {
+                in.read(&byte, 1);
+                length += byte;
+            } while (byte == 255);
+        }
+        return length;
+    };
+
+    while (!in.done()) {
+        unsigned char token;
+        in.read(&token, 1);
+        std::size_t literals = decode_length(token >> 4);
+        if (literals > raw_size - out.size()) {
+            throw std::runtime_error("corrupt compressed chunk in stream");
+        }
+        out.append(in.take(literals), literals);
+        if (in.done()) {
+            break;
+        }
+        std::size_t offset = static_cast<std::size_t>(
+                decode_uint(reinterpret_cast<const unsigned char *>(in.take(2)), 2));
+        std::size_t match = decode_length(token & 15) + LZ_MIN_MATCH;
+        if (offset == 0 || offset > out.size() || match > raw_size - out.size()) {
+            throw std::runtime_error("corrupt compressed chunk in stream");
+        }
+        // byte by byte, matches may overlap the bytes they produce
+        std::size_t from = out.size() - offset;
+        for (std::size_t k = 0; k < match; ++k) {
+            out.push_back(out[from + k]);
+        }
+    }
+    if (out.size() != raw_size) {
+        throw std::runtime_error("corrupt compressed chunk in stream");
+    }
+    return out;
+}
+
+inline const char *stream_magic() {
+    return "CHMSTRM";
+}
+
+// Encodes elements into chunks and writes each chunk once it is full.
+template<class KeyType, class ValueType>
+class StreamWriter {
+public:
+    StreamWriter(std::ostream &out, const SerializeOptions &options, std::size_t size)
+            : out_(out), options_(options) {
+        std::string header(stream_magic(), 8);
+        encode_uint(STREAM_VERSION, 4, header);
+        encode_uint(options_.checksums ? STREAM_CHECKSUMS : 0, 4, header);
+        encode_uint(size, 8, header);
+        write_(header);
+    }
+
+    void add(const KeyType &key, const ValueType &value) {
+        Codec<KeyType>::encode(key, chunk_);
+        Codec<ValueType>::encode(value, chunk_);
+        ++chunk_size_;
+        if (chunk_.size() >= options_.chunk_bytes) {
+            flush_();
+        }
+    }
+
+    void finish() {
+        if (chunk_size_ != 0) {
+            flush_();
+        }
+        flush_();
+        out_.flush();
+        if (!out_) {
+            throw std::runtime_error("can't write stream");
+        }
+    }
+
+private:
+    std::ostream &out_;
+    SerializeOptions options_;
+    std::string chunk_;
+    std::size_t chunk_size_ = 0;
+
+    void write_(const std::string &bytes) {
+        out_.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        if (!out_) {
+            throw std::runtime_error("can't write stream");
+        }
+    }
+
+    // writes the pending chunk, an empty one ends the stream
+    void flush_() {
+        if (chunk_.size() > UINT32_MAX) {
+            throw std::length_error("chunk too large for a map stream");
+        }
+        std::string stored;
+        bool compressed = false;
+        if (options_.compress && !chunk_.empty()) {
+            stored = lz_compress(chunk_);
+            compressed = stored.size() < chunk_.size();
+        }
+        const std::string &bytes = compressed ? stored : chunk_;
+
+        std::string header;
+        encode_uint(chunk_size_, 4, header);
+        encode_uint(chunk_.size(), 4, header);
+        encode_uint(bytes.size(), 4, header);
+        encode_uint(compressed, 1, header);
+        encode_uint(options_.checksums ? crc32(bytes.data(), bytes.size()) : 0, 4, header);
+        write_(header);
+        write_(bytes);
+        chunk_.clear();
+        chunk_size_ = 0;
+    }
+};
+
+// Reads chunks one at a time and decodes their elements on demand, so a reader never holds more than one chunk.
+template<class KeyType, class ValueType>
+class StreamReader {
+    static constexpr std::size_t READ_BLOCK_BYTES = std::size_t(1) << 20;
+
+public:
+    class iterator;
+
+    explicit StreamReader(std::istream &in) : in_(in) {
+        unsigned char header[24];
+        read_(header, sizeof(header));
+        if (std::memcmp(header, stream_magic(), 8) != 0) {
+            throw std::runtime_error("input is no map stream");
+        }
+        if (decode_uint(header + 8, 4) != STREAM_VERSION) {
+            throw std::runtime_error("unsupported map stream version");
+        }
+        checksums_ = decode_uint(header + 12, 4) & STREAM_CHECKSUMS;
+        size_ = decode_uint(header + 16, 8);
+        next_();
+        std::uint64_t first_chunk = std::min<std::uint64_t>(read_size_ + chunk_left_, chunk_.size());
+        size_hint_ = std::min<std::uint64_t>(size_, std::max<std::uint64_t>(first_chunk, bytes_left_()));
+    }
+
+    // the element count the stream announces
+    std::size_t size() const {
+        return static_cast<std::size_t>(size_);
+    }
+
+    // the announced element count, capped by what the data can hold. Every element takes at least one byte, so the
+    // cap is the larger of the bytes left in a seekable stream and the elements that fit into the first chunk.
+    // Compressed streams may hold more elements than that; the cap only keeps a damaged count from sizing a table.
+    std::size_t size_hint() const {
+        return static_cast<std::size_t>(size_hint_);
+    }
+
+    iterator begin() {
+        return iterator(this);
+    }
+
+    iterator end() {
+        return iterator(nullptr);
+    }
+
+    // throws unless the stream ended as announced
+    void finish() const {
+        if (current_ || read_size_ != size_) {
+            throw std::runtime_error("map stream holds a different number of elements than announced");
+        }
+    }
+
+private:
+    std::istream &in_;
+    bool checksums_ = false;
+    std::uint64_t size_ = 0;
+    std::uint64_t size_hint_ = 0;
+    std::uint64_t read_size_ = 0;
+    std::string chunk_;
+    std::size_t chunk_position_ = 0;
+    std::size_t chunk_left_ = 0;
+    bool ended_ = false;
+    std::optional<std::pair<KeyType, ValueType>> current_;
+
+    void read_(void *to, std::size_t n) {
+        in_.read(static_cast<char *>(to), static_cast<std::streamsize>(n));
+        if (static_cast<std::size_t>(in_.gcount()) != n) {
+            throw std::runtime_error("truncated map stream");
+        }
+    }
+
+    // bytes between the read position and the end of a seekable stream, 0 for other streams
+    std::uint64_t bytes_left_() {
+        std::istream::pos_type position = in_.tellg();
+        if (position == std::istream::pos_type(-1)) {
+            in_.clear();
+            return 0;
+        }
+        in_.seekg(0, std::ios::end);
+        std::istream::pos_type end = in_.tellg();
+        in_.clear();
+        in_.seekg(position);
+        return end == std::istream::pos_type(-1) || end < position ? 0 : static_cast<std::uint64_t>(end - position);
+    }
+
+    void read_chunk_() {
+        unsigned char header[17];
+        read_(header, sizeof(header));
+        chunk_left_ = static_cast<std::size_t>(decode_uint(header, 4));
+        std::size_t raw_size = static_cast<std::size_t>(decode_uint(header + 4, 4));
+        std::size_t stored_size = static_cast<std::size_t>(decode_uint(header + 8, 4));
+        bool compressed = header[12] != 0;
+        std::uint32_t checksum = static_cast<std::uint32_t>(decode_uint(header + 13, 4));
+
+        // grown as the bytes arrive, so a damaged size can't allocate more than the stream holds
+        std::string stored;
+        for (std::size_t offset = 0; offset < stored_size;) {
+            std::size_t n = std::min(stored_size - offset, READ_BLOCK_BYTES);
+            stored.resize(offset + n);
+            read_(&stored[offset], n);
+            offset += n;
+        }
+        if (checksums_ && crc32(stored.data(), stored.size()) != checksum) {
+            throw std::runtime_error("checksum mismatch in map stream");
+        }
+        if (compressed) {
+            chunk_ = lz_decompress(stored.data(), stored.size(), raw_size);
+        } else if (stored_size == raw_size) {
+            chunk_ = std::move(stored);
+        } else {
+            throw std::runtime_error("corrupt chunk in map stream");
+        }
+        chunk_position_ = 0;
+        ended_ = chunk_left_ == 0;
+        if (ended_ && !chunk_.empty()) {
+            throw std::runtime_error("corrupt chunk in map stream");
+        }
+    }
+
+    // decodes the next element into current_, or resets it at the end of the stream
+    void next_() {
+        current_.reset();
+        while (chunk_left_ == 0) {
+            if (chunk_position_ != chunk_.size()) {
+                throw std::runtime_error("corrupt chunk in map stream");
+            }
+            if (ended_) {
+                return;
+            }
+            read_chunk_();
+        }
+        ByteReader in(chunk_.data() + chunk_position_, chunk_.size() - chunk_position_);
+        KeyType key = Codec<KeyType>::decode(in);
+        ValueType value = Codec<ValueType>::decode(in);
+        chunk_position_ = static_cast<std::size_t>(in.data() - chunk_.data());
+        current_.emplace(std::move(key), std::move(value));
+        --chunk_left_;
+        ++read_size_;
+    }
+};
+
+// A single pass iterator that moves the decoded elements out of the reader.
+template<class KeyType, class ValueType>
+class StreamReader<KeyType, ValueType>::iterator {
+public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = std::pair<KeyType, ValueType>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = std::pair<KeyType, ValueType> *;
+    using reference = std::pair<KeyType, ValueType> &&;
+
+    explicit iterator(StreamReader *reader) : reader_(reader) {}
+
+    reference operator*() const {
+        return std::move(*reader_->current_);
+    }
+
+    pointer operator->() const {
+        return &*reader_->current_;
+    }
+
+    iterator &operator++() {
+        reader_->next_();
+        return *this;
+    }
+
+    bool operator==(const iterator &other) const {
+        return ended_() == other.ended_();
+    }
+
+    bool operator!=(const iterator &other) const {
+        return !(*this == other);
+    }
+
+private:
+    StreamReader *reader_;
+
+    bool ended_() const {
+        return reader_ == nullptr || !reader_->current_;
+    }
+};
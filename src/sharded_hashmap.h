@@ -0,0 +1,257 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "hashmap.h"
+
+// Splits keys over ShardCount independent HashMaps by the high bits of their mixed hash code. Each shard has its
+// own mutex and its own cache lines, so threads writing different shards never contend, and a shard that grows or
+// shrinks only stalls the threads that need that shard.
+template<class KeyType, class ValueType, class Hash = std::hash<KeyType>, std::size_t ShardCount = 16>
+class ShardedHashMap {
+    static_assert(ShardCount > 0, "ShardCount must be positive");
+
+public:
+    using Shard = HashMap<KeyType, ValueType, Hash>;
+
+    ShardedHashMap(Hash hash_function = Hash());
+
+    ShardedHashMap(const ShardedHashMap &other) = delete;
+
+    ShardedHashMap &operator=(const ShardedHashMap &other) = delete;
+
+    std::size_t size() const;
+
+    bool empty() const;
+
+    Hash hash_function() const;
+
+    bool insert(const std::pair<KeyType, ValueType> &value);
+
+    bool insert_or_assign(const KeyType &key, const ValueType &value);
+
+    bool erase(const KeyType &key);
+
+    typename Shard::node_type extract(const KeyType &key);
+
+    bool insert(typename Shard::node_type &&node);
+
+    bool find(const KeyType &key, ValueType &value) const;
+
+    bool contains(const KeyType &key) const;
+
+    template<class F>
+    void update(const KeyType &key, F f);
+
+    template<class F>
+    void for_each(F f);
+
+    template<class F>
+    void for_each(F f) const;
+
+    template<class F>
+    void for_each_shard(F f);
+
+    template<class F>
+    void for_each_shard(F f) const;
+
+    void clear();
+
+    void reserve(std::size_t n);
+
+    static constexpr std::size_t shard_count() {
+        return ShardCount;
+    }
+
+    std::size_t shard_index(const KeyType &key) const;
+
+private:
+    struct alignas(64) LockedShard {
+        mutable std::mutex mutex;
+        Shard map;
+
+        explicit LockedShard(Hash hash_function) : map(hash_function) {}
+    };
+
+    Hash hash_function_;
+    // allocated one by one, so no two shards share a cache line
+    std::unique_ptr<LockedShard> shards_[ShardCount];
+
+    LockedShard &shard_(const KeyType &key) const;
+};
+
+
+template<class KeyType, class ValueType, class Hash, std::size_t ShardCount>
+ShardedHashMap<KeyType, ValueType, Hash, ShardCount>::ShardedHashMap(Hash hash_function) : hash_function_(hash_function) {
+    for (std::unique_ptr<LockedShard> &shard : shards_) {
+        shard.reset(new LockedShard(hash_function));
+    }
+}
+
+template<class KeyType, class ValueType, class Hash, std::size_t ShardCount>
+std::size_t ShardedHashMap<KeyType, ValueType, Hash, ShardCount>::size() const {
+    // shards are counted one after another, so concurrent writes make this a moving sum
+    std::size_t size = 0;
+    for (const std::unique_ptr<LockedShard> &shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        size += shard->map.size();
+    }
+    return size;
+}
+
+template<class KeyType, class ValueType, class Hash, std::size_t ShardCount>
+bool ShardedHashMap<KeyType, ValueType, Hash, ShardCount>::empty() const {
+    return size() == 0;
+}
+
+template<class KeyType, class ValueType, class Hash, std::size_t ShardCount>
+Hash ShardedHashMap<KeyType, ValueType, Hash, ShardCount>::hash_function() const {
+    return hash_function_;
+}
+
+template<class KeyType, class ValueType, class Hash, std::size_t ShardCount>
+bool ShardedHashMap<KeyType, ValueType, Hash, ShardCount>::insert(const std::pair<KeyType, ValueType> &value) {
+    LockedShard &shard = shard_(value.first);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.map.insert(value).second;
+}
+
+template<class KeyType, class ValueType, class Hash, std::size_t ShardCount>
+bool ShardedHashMap<KeyType, ValueType, Hash, ShardCount>::insert_or_assign(const KeyType &key, const ValueType &value) {
+    LockedShard &shard = shard_(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.map.insert_or_assign(key, value).second;
+}
+
+template<class KeyType, class ValueType, class Hash, std::size_t ShardCount>
+bool ShardedHashMap<KeyType, ValueType, Hash, ShardCount>::erase(const KeyType &key) {
+    LockedShard &shard = shard_(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    std::size_t size = shard.map.size();
+    shard.map.erase(key);
+    return shard.map.size() != size;
+}
+
+// takes the element out of its shard, for moving it into another map without copying it
+template<class KeyType, class ValueType, class Hash, std::size_t ShardCount>
+typename ShardedHashMap<KeyType, ValueType, Hash, ShardCount>::Shard::node_type
+ShardedHashMap<KeyType, ValueType, Hash, ShardCount>::extract(const KeyType &key) {
+    LockedShard &shard = shard_(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.map.extract(key);
+}
+
+// moves the element of the node into its shard unless the key is there, in which case the node keeps it
+template<class KeyType, class ValueType, class Hash, std::size_t ShardCount>
+bool ShardedHashMap<KeyType, ValueType, Hash, ShardCount>::insert(typename Shard::node_type &&node) {
+    if (node.empty()) {
+        return false;
+    }
+    LockedShard &shard = shard_(node.key());
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    typename Shard::insert_return_type result = shard.map.insert(std::move(node));
+    if (!result.inserted) {
+        node = std::move(result.node);
+    }
+    return result.inserted;
+}
+
+template<class KeyType, class ValueType, class Hash, std::size_t ShardCount>
+bool ShardedHashMap<KeyType, ValueType, Hash, ShardCount>::find(const KeyType &key, ValueType &value) const {
+    LockedShard &shard = shard_(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.map.find(key);
+    if (it == shard.map.end()) {
+        return false;
+    }
+    value = it->second;
+    return true;
+}
+
+template<class KeyType, class ValueType, class Hash, std::size_t ShardCount>
+bool ShardedHashMap<KeyType, ValueType, Hash, ShardCount>::contains(const KeyType &key) const {
+    LockedShard &shard = shard_(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.map.find(key) != shard.map.end();
+}
+
+// calls f with a reference to the value of key, which is value-initialized first if missing, with the shard locked
+template<class KeyType, class ValueType, class Hash, std::size_t ShardCount>
+template<class F>
+void ShardedHashMap<KeyType, ValueType, Hash, ShardCount>::update(const KeyType &key, F f) {
+    LockedShard &shard = shard_(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    f(shard.map[key]);
+}
+
+// visits the elements shard by shard, holding only the lock of the shard being visited
+template<class KeyType, class ValueType, class Hash, std::size_t ShardCount>
+template<class F>
+void ShardedHashMap<KeyType, ValueType, Hash, ShardCount>::for_each(F f) {
+    for_each_shard([&f](Shard &map) {
+        for (auto &element : map) {
+            f(element.first, element.second);
+        }
+    });
+}
+
+template<class KeyType, class ValueType, class Hash, std::size_t ShardCount>
+template<class F>
+void ShardedHashMap<KeyType, ValueType, Hash, ShardCount>::for_each(F f) const {
+    for_each_shard([&f](const Shard &map) {
+        for (const auto &element : map) {
+            f(element.first, element.second);
+        }
+    });
+}
+
+// calls f with each shard in turn while holding its lock, e.g. to rehash or inspect shards one at a time
+template<class KeyType, class ValueType, class Hash, std::size_t ShardCount>
+template<class F>
+void ShardedHashMap<KeyType, ValueType, Hash, ShardCount>::for_each_shard(F f) {
+    for (std::unique_ptr<LockedShard> &shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        f(shard->map);
+    }
+}
+
+template<class KeyType, class ValueType, class Hash, std::size_t ShardCount>
+template<class F>
+void ShardedHashMap<KeyType, ValueType, Hash, ShardCount>::for_each_shard(F f) const {
+    for (const std::unique_ptr<LockedShard> &shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        f(static_cast<const Shard &>(shard->map));
+    }
+}
+
+template<class KeyType, class ValueType, class Hash, std::size_t ShardCount>
+void ShardedHashMap<KeyType, ValueType, Hash, ShardCount>::clear() {
+    for_each_shard([](Shard &map) {
+        map.clear();
+    });
+}
+
+template<class KeyType, class ValueType, class Hash, std::size_t ShardCount>
+void ShardedHashMap<KeyType, ValueType, Hash, ShardCount>::reserve(std::size_t n) {
+    // keys spread evenly, so every shard gets its share
+    std::size_t shard_size = (n + ShardCount - 1) / ShardCount;
+    for_each_shard([shard_size](Shard &map) {
+        map.reserve(shard_size);
+    });
+}
+
+template<class KeyType, class ValueType, class Hash, std::size_t ShardCount>
+std::size_t ShardedHashMap<KeyType, ValueType, Hash, ShardCount>::shard_index(const KeyType &key) const {
+    // the high bits of the mixed code, the shards themselves pick slots from all bits of the hash code
+    return FastRangeIndexer::index(hash_function_(key), ShardCount);
+}
+
+template<class KeyType, class ValueType, class Hash, std::size_t ShardCount>
+typename ShardedHashMap<KeyType, ValueType, Hash, ShardCount>::LockedShard &
+ShardedHashMap<KeyType, ValueType, Hash, ShardCount>::shard_(const KeyType &key) const {
+    return *shards_[shard_index(key)];
+}
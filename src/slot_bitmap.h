@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Packed occupancy bitmaps, one bit per slot. The searches handle the word they start in bitwise, then skip whole
+// words that can't contain a match several at a time with AVX2, SSE2 or NEON, and fall back to one word per step.
+
+constexpr std::size_t BITMAP_WORD_BITS = 64;
+
+inline std::size_t bitmap_words(std::size_t bits) {
+    return (bits + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS;
+}
+
+inline bool test_bit(const std::uint64_t *words, std::size_t i) {
+    return words[i / BITMAP_WORD_BITS] >> (i % BITMAP_WORD_BITS) & 1;
+}
+
+inline void set_bit(std::uint64_t *words, std::size_t i) {
+    words[i / BITMAP_WORD_BITS] |= std::uint64_t(1) << (i % BITMAP_WORD_BITS);
+}
+
+inline void clear_bit(std::uint64_t *words, std::size_t i) {
+    words[i / BITMAP_WORD_BITS] &= ~(std::uint64_t(1) << (i % BITMAP_WORD_BITS));
+}
+
+inline std::size_t count_trailing_zeros(std::uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(word);
+#else
+    std::size_t count = 0;
+    while (!(word & 1)) {
+        word >>= 1;
+        ++count;
+    }
+    return count;
+#endif
+}
+
+inline std::size_t count_leading_zeros(std::uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_clzll(word);
+#else
+    std::size_t count = 0;
+    while (!(word >> 63)) {
+        word <<= 1;
+        ++count;
+    }
+    return count;
+#endif
+}
+
+// first word in [w, words_size) that isn't zero, or words_size
+inline std::size_t skip_zero_words(const std::uint64_t *words, std::size_t w, std::size_t words_size) {
+#if defined(__AVX2__)
+    for (; w + 4 <= words_size; w += 4) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(words + w));
+        if (!_mm256_testz_si256(block, block)) {
+            break;
+        }
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    for (; w + 2 <= words_size; w += 2) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(words + w));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_setzero_si128())) != 0xFFFF) {
+            break;
+        }
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    for (; w + 2 <= words_size; w += 2) {
+        uint32x4_t block = vreinterpretq_u32_u64(vld1q_u64(words + w));
+        if (vmaxvq_u32(block) != 0) {
+            break;
+        }
+    }
+#endif
+    while (w < words_size && words[w] == 0) {
+        ++w;
+    }
+    return w;
+}
+
+// one past the last word below w that isn't all ones, or 0
+inline std::size_t skip_full_words(const std::uint64_t *words, std::size_t w) {
+#if defined(__AVX2__)
+    for (; w >= 4; w -= 4) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(words + w - 4));
+        if (!_mm256_testc_si256(block, _mm256_set1_epi64x(-1))) {
+            break;
+        }
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    for (; w >= 2; w -= 2) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(words + w - 2));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8(-1))) != 0xFFFF) {
+            break;
+        }
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    for (; w >= 2; w -= 2) {
+        uint32x4_t block = vreinterpretq_u32_u64(vld1q_u64(words + w - 2));
+        if (vminvq_u32(block) != 0xFFFFFFFF) {
+            break;
+        }
+    }
+#endif
+    while (w > 0 && words[w - 1] == ~std::uint64_t(0)) {
+        --w;
+    }
+    return w;
+}
+
+// the first set bit at or after i, or size if there is none; bits past size must be clear
+inline std::size_t find_next_set(const std::uint64_t *words, std::size_t size, std::size_t i) {
+    if (i >= size) {
+        return size;
+    }
+    std::size_t w = i / BITMAP_WORD_BITS;
+    std::uint64_t word = words[w] >> (i % BITMAP_WORD_BITS);
+    if (word != 0) {
+        return i + count_trailing_zeros(word);
+    }
+
+    std::size_t words_size = bitmap_words(size);
+    w = skip_zero_words(words, w + 1, words_size);
+    if (w == words_size) {
+        return size;
+    }
+    return w * BITMAP_WORD_BITS + count_trailing_zeros(words[w]);
+}
+
+// the last clear bit at or before i, or size if there is none; i must be below size
+inline std::size_t find_prev_clear(const std::uint64_t *words, std::size_t size, std::size_t i) {
+    std::size_t w = i / BITMAP_WORD_BITS;
+    std::size_t shift = BITMAP_WORD_BITS - 1 - i % BITMAP_WORD_BITS;
+    // moves bit i to the top, so leading zeros count the distance down to the next clear bit
+    std::uint64_t word = ~words[w] << shift;
+    if (word != 0) {
+        return i - count_leading_zeros(word);
+    }
+
+    w = skip_full_words(words, w);
+    if (w == 0) {
+        return size;
+    }
+    return w * BITMAP_WORD_BITS - 1 - count_leading_zeros(~words[w - 1]);
+}
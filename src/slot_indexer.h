@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// Indexers turn a hash code into a hash address in [0, address_size). address_size() rounds a requested address
+// region size up to one the indexer supports, and index() does the reduction on every lookup. Both are constexpr, so
+// tables can also be laid out at compile time.
+
+// Spreads the entropy of the whole hash code over all of its bits, so identity hashes of sequential integers don't
+// end up in the same few addresses when only part of the bits is used.
+constexpr std::uint64_t mix_hash(std::uint64_t hash) {
+    hash ^= hash >> 32;
+    hash *= 0x9e3779b97f4a7c15ULL;
+    hash ^= hash >> 29;
+    return hash;
+}
+
+// Reduces the hash code with a division. Works for any table size and uses the hash code as is.
+struct ModuloIndexer {
+    static constexpr std::size_t address_size(std::size_t n) {
+        return n;
+    }
+
+    static constexpr std::size_t index(std::size_t hash, std::size_t address_size) {
+        return hash % address_size;
+    }
+};
+
+// Keeps the address region a power of two and masks the mixed hash code, which avoids the division entirely.
+struct PowerOfTwoIndexer {
+    static constexpr std::size_t address_size(std::size_t n) {
+        std::size_t size = 1;
+        while (size < n) {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    static constexpr std::size_t index(std::size_t hash, std::size_t address_size) {
+        return static_cast<std::size_t>(mix_hash(hash)) & (address_size - 1);
+    }
+};
+
+// Lemire's multiply-shift reduction of the mixed hash code. Works for any table size without a division.
+struct FastRangeIndexer {
+    static constexpr std::size_t address_size(std::size_t n) {
+        return n;
+    }
+
+    static constexpr std::size_t index(std::size_t hash, std::size_t address_size) {
+#if defined(__SIZEOF_INT128__)
+        return static_cast<std::size_t>((static_cast<unsigned __int128>(mix_hash(hash)) * address_size) >> 64);
+#else
+        return static_cast<std::size_t>((mix_hash(hash) >> 32) * address_size >> 32);
+#endif
+    }
+};
@@ -0,0 +1,958 @@
+#pragma once
+
+#include <limits>
+#include <new>
+#include <cstdint>
+#include <utility>
+#include <memory>
+#include <cstring>
+#include <type_traits>
+#include <algorithm>
+#include <tuple>
+
+#include "slot_bitmap.h"
+
+// Slot layouts decide how a HashMap stores its slots. Every layout provides a Table template with the same
+// index-based interface, so the hashing and chaining code doesn't depend on where keys, values and links live.
+
+// Hash code storage policies. Tables that store hash codes compare them before keys in chain walks, and the map
+// reuses them instead of rehashing keys when it relinks chains or moves elements into a new table.
+
+// Doesn't store hash codes.
+struct NoStoredHash {
+    static constexpr bool ENABLED = false;
+
+    using hash_type = unsigned char;
+
+    static constexpr bool FULL_HASH = false;
+
+    struct Field {
+    };
+};
+
+// Stores the hash code of every element truncated to HashCodeType. Hash addresses always come from the full code, so
+// a narrow code only filters key compares; the map hashes keys again wherever it needs the address of a stored
+// element and the stored code is narrower than std::size_t.
+template<class HashCodeType = std::size_t>
+struct StoredHash {
+    static constexpr bool ENABLED = true;
+
+    using hash_type = HashCodeType;
+
+    // whether the stored code is the full hash code, from which the map can derive hash addresses
+    static constexpr bool FULL_HASH = sizeof(HashCodeType) >= sizeof(std::size_t);
+
+    struct Field {
+        HashCodeType hash;
+    };
+};
+
+// Keeps the key-value pair and the link of a slot together. Occupancy lives in a packed bitmap beside the slots.
+struct InterleavedLayout {
+    template<class KeyType, class ValueType, class IndexType, class HashStorage, class Allocator>
+    class Table;
+};
+
+// Keeps links apart from keys and values, so chain walks touch only metadata and keys until they hit. Elements are
+// exposed as pairs of references.
+struct SplitLayout {
+    template<class KeyType, class ValueType, class IndexType, class HashStorage, class Allocator>
+    class Table;
+};
+
+
+// Uninitialized storage for one object. Tables construct and destroy elements in it explicitly when slots become
+// occupied or free, so empty slots never hold keys or values.
+template<class T>
+class RawStorage {
+public:
+    template<class Allocator, class... Args>
+    void construct(Allocator &allocator, Args &&... args) {
+        std::allocator_traits<Allocator>::construct(allocator, reinterpret_cast<T *>(bytes_),
+                                                    std::forward<Args>(args)...);
+    }
+
+    template<class Allocator>
+    void destroy(Allocator &allocator) {
+        std::allocator_traits<Allocator>::destroy(allocator, get());
+    }
+
+    T *get() {
+        return std::launder(reinterpret_cast<T *>(bytes_));
+    }
+
+    const T *get() const {
+        return std::launder(reinterpret_cast<const T *>(bytes_));
+    }
+
+private:
+    alignas(T) unsigned char bytes_[sizeof(T)];
+};
+
+// Moves the object of from into the uninitialized to and ends its lifetime in from. Trivially copyable types
+// are copied bytewise.
+template<class T, class Allocator>
+void relocate(RawStorage<T> &to, RawStorage<T> &from, Allocator &allocator) {
+    if constexpr (std::is_trivially_copyable<T>::value) {
+        std::memcpy(static_cast<void *>(&to), &from, sizeof(T));
+    } else {
+        to.construct(allocator, std::move(*from.get()));
+        from.destroy(allocator);
+    }
+}
+
+// Allocates an array of n default-initialized T with allocator rebound to T.
+template<class T, class Allocator>
+T *allocate_array(const Allocator &allocator, std::size_t n) {
+    using ArrayAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<T>;
+    ArrayAllocator array_allocator(allocator);
+    T *array = std::allocator_traits<ArrayAllocator>::allocate(array_allocator, n);
+    for (std::size_t i = 0; i < n; ++i) {
+        new(array + i) T;
+    }
+    return array;
+}
+
+// T must be trivially destructible, elements in RawStorage are destroyed by the table beforehand.
+template<class T, class Allocator>
+void deallocate_array(const Allocator &allocator, T *array, std::size_t n) {
+    using ArrayAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<T>;
+    static_assert(std::is_trivially_destructible<T>::value, "array elements must be trivially destructible");
+    if (array != nullptr) {
+        ArrayAllocator array_allocator(allocator);
+        std::allocator_traits<ArrayAllocator>::deallocate(array_allocator, array, n);
+    }
+}
+
+// Hints that the cache line holding address will be read soon.
+inline void prefetch_read(const void *address) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(address, 0, 3);
+#elif defined(_M_X64)
+    _mm_prefetch(static_cast<const char *>(address), _MM_HINT_T0);
+#else
+    (void) address;
+#endif
+}
+
+// Holds the allocator of a table and applies the propagation rules of standard containers to it on assignment and
+// swap. Tables only ever take over storage from tables with an equal allocator.
+template<class Allocator>
+class TableAllocator {
+public:
+    Allocator get_allocator() const {
+        return allocator_;
+    }
+
+protected:
+    using Traits = std::allocator_traits<Allocator>;
+
+    static constexpr bool NOTHROW_MOVE_ASSIGNMENT = Traits::propagate_on_container_move_assignment::value ||
+                                                    Traits::is_always_equal::value;
+
+    Allocator allocator_;
+
+    TableAllocator() = default;
+
+    explicit TableAllocator(const Allocator &allocator) : allocator_(allocator) {}
+
+    TableAllocator(const TableAllocator &other) = default;
+
+    TableAllocator &operator=(const TableAllocator &other) = delete;
+
+    // the allocator a copy of other that gets assigned to this table has to use
+    const Allocator &copy_assignment_allocator_(const TableAllocator &other) const {
+        if constexpr (Traits::propagate_on_container_copy_assignment::value) {
+            return other.allocator_;
+        } else {
+            return allocator_;
+        }
+    }
+
+    void propagate_on_copy_assignment_(const TableAllocator &other) {
+        if constexpr (Traits::propagate_on_container_copy_assignment::value) {
+            allocator_ = other.allocator_;
+        }
+    }
+
+    // whether move assignment can take over the storage of other instead of moving elements one by one
+    bool can_take_storage_(const TableAllocator &other) const {
+        if constexpr (NOTHROW_MOVE_ASSIGNMENT) {
+            return true;
+        } else {
+            return allocator_ == other.allocator_;
+        }
+    }
+
+    void propagate_on_move_assignment_(const TableAllocator &other) {
+        if constexpr (Traits::propagate_on_container_move_assignment::value) {
+            allocator_ = other.allocator_;
+        }
+    }
+
+    void swap_allocator_(TableAllocator &other) noexcept {
+        if constexpr (Traits::propagate_on_container_swap::value) {
+            using std::swap;
+            swap(allocator_, other.allocator_);
+        }
+    }
+};
+
+template<class Reference>
+class ArrowProxy {
+public:
+    explicit ArrowProxy(Reference reference) : reference_(reference) {}
+
+    Reference *operator->() {
+        return &reference_;
+    }
+
+private:
+    Reference reference_;
+};
+
+
+template<class KeyType, class ValueType, class IndexType, class HashStorage, class Allocator>
+class InterleavedLayout::Table : public TableAllocator<Allocator> {
+public:
+    using reference = std::pair<const KeyType, ValueType> &;
+    using const_reference = const std::pair<const KeyType, ValueType> &;
+    using pointer = std::pair<const KeyType, ValueType> *;
+    using const_pointer = const std::pair<const KeyType, ValueType> *;
+
+    static constexpr IndexType NULL_INDEX = std::numeric_limits<IndexType>::max();
+
+    // copies own their slots, see PagedLayout for tables that share them
+    static constexpr bool COPY_ON_WRITE = false;
+
+    // snapshots store the bitmap and the slots, see snapshot.h
+    static constexpr std::uint32_t SNAPSHOT_LAYOUT = 1;
+    static constexpr std::size_t SNAPSHOT_ARRAYS = 2;
+
+    class View;
+
+    static void snapshot_bytes(std::size_t size, std::uint64_t *bytes) {
+        bytes[0] = bitmap_words(size) * sizeof(std::uint64_t);
+        bytes[1] = size * sizeof(Slot);
+    }
+
+    void snapshot_arrays(const void **arrays) const {
+        arrays[0] = occupied_;
+        arrays[1] = slots_;
+    }
+
+    Table() = default;
+
+    explicit Table(const Allocator &allocator) : TableAllocator<Allocator>(allocator) {}
+
+    Table(const Table &other)
+            : Table(other, std::allocator_traits<Allocator>::select_on_container_copy_construction(other.allocator_)) {}
+
+    Table(const Table &other, const Allocator &allocator) : TableAllocator<Allocator>(allocator) {
+        assign(other.size_);
+        try {
+            for (std::size_t i = 0; i < size_; ++i) {
+                static_cast<typename HashStorage::Field &>(slots_[i]) = other.slots_[i];
+                slots_[i].link = other.slots_[i].link;
+                if (!other.empty(i)) {
+                    slots_[i].value.construct(this->allocator_, *other.slots_[i].value.get());
+                    set_bit(occupied_, i);
+                }
+            }
+        } catch (...) {
+            clear();
+            throw;
+        }
+    }
+
+    Table(Table &&other) noexcept : TableAllocator<Allocator>(other) {
+        take_storage_(other);
+    }
+
+    // moves the elements one by one into storage from allocator, other is left without slots
+    Table(Table &&other, const Allocator &allocator) : TableAllocator<Allocator>(allocator) {
+        assign(other.size_);
+        try {
+            for (std::size_t i = 0; i < size_; ++i) {
+                slots_[i].link = other.slots_[i].link;
+                if (!other.empty(i)) {
+                    relocate(i, other, i);
+                }
+            }
+        } catch (...) {
+            clear();
+            throw;
+        }
+        other.clear();
+    }
+
+    Table &operator=(const Table &other) {
+        if (this != &other) {
+            Table copy(other, this->copy_assignment_allocator_(other));
+            clear();
+            this->propagate_on_copy_assignment_(other);
+            take_storage_(copy);
+        }
+        return *this;
+    }
+
+    Table &operator=(Table &&other) noexcept(TableAllocator<Allocator>::NOTHROW_MOVE_ASSIGNMENT) {
+        if (this == &other) {
+            return *this;
+        }
+        if (this->can_take_storage_(other)) {
+            clear();
+            this->propagate_on_move_assignment_(other);
+            take_storage_(other);
+        } else {
+            Table moved(std::move(other), this->allocator_);
+            take_storage_(moved);
+        }
+        return *this;
+    }
+
+    ~Table() {
+        clear();
+    }
+
+    std::size_t size() const {
+        return size_;
+    }
+
+    // empty slots only get their metadata initialized
+    void assign(std::size_t slots_size) {
+        clear();
+        slots_ = allocate_array<Slot>(this->allocator_, slots_size);
+        try {
+            occupied_ = allocate_array<std::uint64_t>(this->allocator_, bitmap_words(slots_size));
+        } catch (...) {
+            deallocate_array(this->allocator_, slots_, slots_size);
+            slots_ = nullptr;
+            throw;
+        }
+        std::fill(occupied_, occupied_ + bitmap_words(slots_size), 0);
+        size_ = slots_size;
+    }
+
+    void clear() {
+        for (std::size_t i = next_occupied(0); i < size_; i = next_occupied(i + 1)) {
+            slots_[i].value.destroy(this->allocator_);
+        }
+        deallocate_array(this->allocator_, slots_, size_);
+        deallocate_array(this->allocator_, occupied_, bitmap_words(size_));
+        slots_ = nullptr;
+        occupied_ = nullptr;
+        size_ = 0;
+    }
+
+    void swap(Table &other) noexcept {
+        this->swap_allocator_(other);
+        std::swap(slots_, other.slots_);
+        std::swap(occupied_, other.occupied_);
+        std::swap(size_, other.size_);
+    }
+
+    bool empty(std::size_t i) const {
+        return !test_bit(occupied_, i);
+    }
+
+    IndexType link(std::size_t i) const {
+        return slots_[i].link;
+    }
+
+    void set_link(std::size_t i, IndexType link) {
+        slots_[i].link = link;
+    }
+
+    const KeyType &key(std::size_t i) const {
+        return slots_[i].value.get()->first;
+    }
+
+    ValueType &mapped(std::size_t i) {
+        return slots_[i].value.get()->second;
+    }
+
+    reference value(std::size_t i) {
+        return *slots_[i].value.get();
+    }
+
+    const_reference value(std::size_t i) const {
+        return *slots_[i].value.get();
+    }
+
+    pointer address(std::size_t i) {
+        return slots_[i].value.get();
+    }
+
+    const_pointer address(std::size_t i) const {
+        return slots_[i].value.get();
+    }
+
+    // constructs the element of a free slot from the arguments of a std::pair constructor
+    template<class... Args>
+    void construct(std::size_t i, std::size_t hash, Args &&... args) {
+        slots_[i].value.construct(this->allocator_, std::forward<Args>(args)...);
+        if constexpr (HashStorage::ENABLED) {
+            slots_[i].hash = static_cast<typename HashStorage::hash_type>(hash);
+        }
+        set_bit(occupied_, i);
+    }
+
+    // moves the element in slot j of from into the free slot i and frees slot j, keeping both links
+    void relocate(std::size_t i, Table &from, std::size_t j) {
+        relocate_element(i, from, j);
+        clear_bit(from.occupied_, j);
+    }
+
+    // like relocate, but slot j stays marked occupied, so threads can empty slots that share a bitmap word of from;
+    // from has to forget_elements() once all of them are moved out
+    void relocate_element(std::size_t i, Table &from, std::size_t j) {
+        Slot &slot = slots_[i];
+        Slot &source = from.slots_[j];
+        if constexpr (std::is_trivially_copyable<KeyType>::value && std::is_trivially_copyable<ValueType>::value) {
+            std::memcpy(static_cast<void *>(&slot.value), &source.value, sizeof(slot.value));
+        } else {
+            std::pair<const KeyType, ValueType> &value = *source.value.get();
+            // the source is destroyed right away, so its key may be moved from despite being const
+            slot.value.construct(this->allocator_, std::move(const_cast<KeyType &>(value.first)),
+                                 std::move(value.second));
+            source.value.destroy(from.allocator_);
+        }
+        static_cast<typename HashStorage::Field &>(slot) = source;
+        set_bit(occupied_, i);
+    }
+
+    // marks every slot free without destroying anything, after relocate_element() moved out all elements
+    void forget_elements() {
+        std::fill(occupied_, occupied_ + bitmap_words(size_), 0);
+    }
+
+    std::size_t hash(std::size_t i) const {
+        return slots_[i].hash;
+    }
+
+    // replaces the stored hash code of an occupied slot, e.g. after the hash function changed
+    void set_hash(std::size_t i, std::size_t hash) {
+        if constexpr (HashStorage::ENABLED) {
+            slots_[i].hash = static_cast<typename HashStorage::hash_type>(hash);
+        }
+    }
+
+    bool hash_matches(std::size_t i, std::size_t hash) const {
+        if constexpr (HashStorage::ENABLED) {
+            return slots_[i].hash == static_cast<typename HashStorage::hash_type>(hash);
+        } else {
+            return true;
+        }
+    }
+
+    // destroys the element but keeps the link, so chains passing through the slot stay walkable
+    void destroy(std::size_t i) {
+        slots_[i].value.destroy(this->allocator_);
+        clear_bit(occupied_, i);
+    }
+
+    void init_empty(std::size_t i) {
+        if (!empty(i)) {
+            destroy(i);
+        }
+        slots_[i].link = NULL_INDEX;
+    }
+
+    // loads the cache lines that a chain walk reads at slot i
+    void prefetch(std::size_t i) const {
+        prefetch_read(slots_ + i);
+        prefetch_read(occupied_ + i / BITMAP_WORD_BITS);
+    }
+
+    std::size_t next_occupied(std::size_t i) const {
+        return find_next_set(occupied_, size_, i);
+    }
+
+    // the largest free slot at or below i, or size() if there is none
+    std::size_t prev_free(std::size_t i) const {
+        return find_prev_clear(occupied_, size_, i);
+    }
+
+private:
+    struct Slot : HashStorage::Field {
+        RawStorage<std::pair<const KeyType, ValueType>> value;
+        IndexType link = NULL_INDEX;
+    };
+
+    Slot *slots_ = nullptr;
+    std::uint64_t *occupied_ = nullptr;
+    std::size_t size_ = 0;
+
+    // other has to use an equal allocator
+    void take_storage_(Table &other) noexcept {
+        slots_ = other.slots_;
+        occupied_ = other.occupied_;
+        size_ = other.size_;
+        other.slots_ = nullptr;
+        other.occupied_ = nullptr;
+        other.size_ = 0;
+    }
+};
+
+
+// Read-only lookup interface over the arrays of a table stored in a snapshot.
+template<class KeyType, class ValueType, class IndexType, class HashStorage, class Allocator>
+class InterleavedLayout::Table<KeyType, ValueType, IndexType, HashStorage, Allocator>::View {
+public:
+    View() = default;
+
+    View(const void *const *arrays, std::size_t size)
+            : occupied_(static_cast<const std::uint64_t *>(arrays[0])), slots_(static_cast<const Slot *>(arrays[1])),
+              size_(size) {}
+
+    std::size_t size() const {
+        return size_;
+    }
+
+    bool empty(std::size_t i) const {
+        return !test_bit(occupied_, i);
+    }
+
+    IndexType link(std::size_t i) const {
+        return slots_[i].link;
+    }
+
+    const KeyType &key(std::size_t i) const {
+        return slots_[i].value.get()->first;
+    }
+
+    const_reference value(std::size_t i) const {
+        return *slots_[i].value.get();
+    }
+
+    const_pointer address(std::size_t i) const {
+        return slots_[i].value.get();
+    }
+
+    bool hash_matches(std::size_t i, std::size_t hash) const {
+        if constexpr (HashStorage::ENABLED) {
+            return slots_[i].hash == static_cast<typename HashStorage::hash_type>(hash);
+        } else {
+            return true;
+        }
+    }
+
+    std::size_t next_occupied(std::size_t i) const {
+        return find_next_set(occupied_, size_, i);
+    }
+
+    // whether the bits past the last slot are clear, which the bitmap searches rely on
+    bool bitmap_ends_clear() const {
+        return size_ % BITMAP_WORD_BITS == 0 || occupied_[size_ / BITMAP_WORD_BITS] >> (size_ % BITMAP_WORD_BITS) == 0;
+    }
+
+private:
+    const std::uint64_t *occupied_ = nullptr;
+    const Slot *slots_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+
+template<class KeyType, class ValueType, class IndexType, class HashStorage, class Allocator>
+class SplitLayout::Table : public TableAllocator<Allocator> {
+public:
+    using reference = std::pair<const KeyType &, ValueType &>;
+    using const_reference = std::pair<const KeyType &, const ValueType &>;
+    using pointer = ArrowProxy<reference>;
+    using const_pointer = ArrowProxy<const_reference>;
+
+    static constexpr IndexType NULL_INDEX = std::numeric_limits<IndexType>::max();
+
+    // copies own their slots, see PagedLayout for tables that share them
+    static constexpr bool COPY_ON_WRITE = false;
+
+    // snapshots store the links, the bitmap, keys, values and hash codes, see snapshot.h
+    static constexpr std::uint32_t SNAPSHOT_LAYOUT = 2;
+    static constexpr std::size_t SNAPSHOT_ARRAYS = 5;
+
+    class View;
+
+    static void snapshot_bytes(std::size_t size, std::uint64_t *bytes) {
+        bytes[0] = size * sizeof(IndexType);
+        bytes[1] = bitmap_words(size) * sizeof(std::uint64_t);
+        bytes[2] = size * sizeof(RawStorage<KeyType>);
+        bytes[3] = size * sizeof(RawStorage<ValueType>);
+        bytes[4] = HashStorage::ENABLED ? size * sizeof(typename HashStorage::hash_type) : 0;
+    }
+
+    void snapshot_arrays(const void **arrays) const {
+        arrays[0] = links_;
+        arrays[1] = occupied_;
+        arrays[2] = keys_;
+        arrays[3] = values_;
+        arrays[4] = hashes_;
+    }
+
+    Table() = default;
+
+    explicit Table(const Allocator &allocator) : TableAllocator<Allocator>(allocator) {}
+
+    Table(const Table &other)
+            : Table(other, std::allocator_traits<Allocator>::select_on_container_copy_construction(other.allocator_)) {}
+
+    Table(const Table &other, const Allocator &allocator) : TableAllocator<Allocator>(allocator) {
+        assign(other.size_);
+        std::copy(other.links_, other.links_ + size_, links_);
+        if constexpr (HashStorage::ENABLED) {
+            std::copy(other.hashes_, other.hashes_ + size_, hashes_);
+        }
+        try {
+            for (std::size_t i = other.next_occupied(0); i < size_; i = other.next_occupied(i + 1)) {
+                keys_[i].construct(this->allocator_, *other.keys_[i].get());
+                try {
+                    values_[i].construct(this->allocator_, *other.values_[i].get());
+                } catch (...) {
+                    keys_[i].destroy(this->allocator_);
+                    throw;
+                }
+                set_bit(occupied_, i);
+            }
+        } catch (...) {
+            clear();
+            throw;
+        }
+    }
+
+    Table(Table &&other) noexcept : TableAllocator<Allocator>(other) {
+        take_storage_(other);
+    }
+
+    // moves the elements one by one into storage from allocator, other is left without slots
+    Table(Table &&other, const Allocator &allocator) : TableAllocator<Allocator>(allocator) {
+        assign(other.size_);
+        std::copy(other.links_, other.links_ + size_, links_);
+        try {
+            for (std::size_t i = other.next_occupied(0); i < size_; i = other.next_occupied(i + 1)) {
+                relocate(i, other, i);
+            }
+        } catch (...) {
+            clear();
+            throw;
+        }
+        other.clear();
+    }
+
+    Table &operator=(const Table &other) {
+        if (this != &other) {
+            Table copy(other, this->copy_assignment_allocator_(other));
+            clear();
+            this->propagate_on_copy_assignment_(other);
+            take_storage_(copy);
+        }
+        return *this;
+    }
+
+    Table &operator=(Table &&other) noexcept(TableAllocator<Allocator>::NOTHROW_MOVE_ASSIGNMENT) {
+        if (this == &other) {
+            return *this;
+        }
+        if (this->can_take_storage_(other)) {
+            clear();
+            this->propagate_on_move_assignment_(other);
+            take_storage_(other);
+        } else {
+            Table moved(std::move(other), this->allocator_);
+            take_storage_(moved);
+        }
+        return *this;
+    }
+
+    ~Table() {
+        clear();
+    }
+
+    std::size_t size() const {
+        return size_;
+    }
+
+    // keys and values stay uninitialized until their slot is taken
+    void assign(std::size_t slots_size) {
+        clear();
+        try {
+            links_ = allocate_array<IndexType>(this->allocator_, slots_size);
+            occupied_ = allocate_array<std::uint64_t>(this->allocator_, bitmap_words(slots_size));
+            keys_ = allocate_array<RawStorage<KeyType>>(this->allocator_, slots_size);
+            values_ = allocate_array<RawStorage<ValueType>>(this->allocator_, slots_size);
+            if constexpr (HashStorage::ENABLED) {
+                hashes_ = allocate_array<typename HashStorage::hash_type>(this->allocator_, slots_size);
+            }
+        } catch (...) {
+            size_ = slots_size;
+            deallocate_();
+            throw;
+        }
+        size_ = slots_size;
+        std::fill(links_, links_ + size_, NULL_INDEX);
+        std::fill(occupied_, occupied_ + bitmap_words(size_), 0);
+    }
+
+    void clear() {
+        for (std::size_t i = next_occupied(0); i < size_; i = next_occupied(i + 1)) {
+            keys_[i].destroy(this->allocator_);
+            values_[i].destroy(this->allocator_);
+        }
+        deallocate_();
+    }
+
+    void swap(Table &other) noexcept {
+        this->swap_allocator_(other);
+        std::swap(size_, other.size_);
+        std::swap(links_, other.links_);
+        std::swap(occupied_, other.occupied_);
+        std::swap(keys_, other.keys_);
+        std::swap(values_, other.values_);
+        std::swap(hashes_, other.hashes_);
+    }
+
+    bool empty(std::size_t i) const {
+        return !test_bit(occupied_, i);
+    }
+
+    IndexType link(std::size_t i) const {
+        return links_[i];
+    }
+
+    void set_link(std::size_t i, IndexType link) {
+        links_[i] = link;
+    }
+
+    const KeyType &key(std::size_t i) const {
+        return *keys_[i].get();
+    }
+
+    ValueType &mapped(std::size_t i) {
+        return *values_[i].get();
+    }
+
+    reference value(std::size_t i) {
+        return reference(*keys_[i].get(), *values_[i].get());
+    }
+
+    const_reference value(std::size_t i) const {
+        return const_reference(*keys_[i].get(), *values_[i].get());
+    }
+
+    pointer address(std::size_t i) {
+        return pointer(value(i));
+    }
+
+    const_pointer address(std::size_t i) const {
+        return const_pointer(value(i));
+    }
+
+    // constructs the element of a free slot from the arguments of a std::pair constructor, through a temporary pair
+    template<class... Args>
+    void construct(std::size_t i, std::size_t hash, Args &&... args) {
+        std::pair<KeyType, ValueType> value(std::forward<Args>(args)...);
+        keys_[i].construct(this->allocator_, std::move(value.first));
+        try {
+            values_[i].construct(this->allocator_, std::move(value.second));
+        } catch (...) {
+            keys_[i].destroy(this->allocator_);
+            throw;
+        }
+        if constexpr (HashStorage::ENABLED) {
+            hashes_[i] = static_cast<typename HashStorage::hash_type>(hash);
+        }
+        set_bit(occupied_, i);
+    }
+
+    // constructs the key and the value in place from their argument tuples, without a temporary pair
+    template<class... KeyArgs, class... ValueArgs>
+    void construct(std::size_t i, std::size_t hash, std::piecewise_construct_t, std::tuple<KeyArgs...> key_args,
+                   std::tuple<ValueArgs...> value_args) {
+        std::apply([&](auto &&... args) {
+            keys_[i].construct(this->allocator_, std::forward<decltype(args)>(args)...);
+        }, std::move(key_args));
+        try {
+            std::apply([&](auto &&... args) {
+                values_[i].construct(this->allocator_, std::forward<decltype(args)>(args)...);
+            }, std::move(value_args));
+        } catch (...) {
+            keys_[i].destroy(this->allocator_);
+            throw;
+        }
+        if constexpr (HashStorage::ENABLED) {
+            hashes_[i] = static_cast<typename HashStorage::hash_type>(hash);
+        }
+        set_bit(occupied_, i);
+    }
+
+    // moves the element in slot j of from into the free slot i and frees slot j, keeping both links
+    void relocate(std::size_t i, Table &from, std::size_t j) {
+        relocate_element(i, from, j);
+        clear_bit(from.occupied_, j);
+    }
+
+    // like relocate, but slot j stays marked occupied, so threads can empty slots that share a bitmap word of from;
+    // from has to forget_elements() once all of them are moved out
+    void relocate_element(std::size_t i, Table &from, std::size_t j) {
+        ::relocate(keys_[i], from.keys_[j], this->allocator_);
+        ::relocate(values_[i], from.values_[j], this->allocator_);
+        if constexpr (HashStorage::ENABLED) {
+            hashes_[i] = from.hashes_[j];
+        }
+        set_bit(occupied_, i);
+    }
+
+    // marks every slot free without destroying anything, after relocate_element() moved out all elements
+    void forget_elements() {
+        std::fill(occupied_, occupied_ + bitmap_words(size_), 0);
+    }
+
+    std::size_t hash(std::size_t i) const {
+        return hashes_[i];
+    }
+
+    // replaces the stored hash code of an occupied slot, e.g. after the hash function changed
+    void set_hash(std::size_t i, std::size_t hash) {
+        if constexpr (HashStorage::ENABLED) {
+            hashes_[i] = static_cast<typename HashStorage::hash_type>(hash);
+        }
+    }
+
+    bool hash_matches(std::size_t i, std::size_t hash) const {
+        if constexpr (HashStorage::ENABLED) {
+            return hashes_[i] == static_cast<typename HashStorage::hash_type>(hash);
+        } else {
+            return true;
+        }
+    }
+
+    // destroys the element but keeps the link, so chains passing through the slot stay walkable
+    void destroy(std::size_t i) {
+        keys_[i].destroy(this->allocator_);
+        values_[i].destroy(this->allocator_);
+        clear_bit(occupied_, i);
+    }
+
+    void init_empty(std::size_t i) {
+        if (!empty(i)) {
+            destroy(i);
+        }
+        links_[i] = NULL_INDEX;
+    }
+
+    // loads the cache lines that a chain walk reads at slot i
+    void prefetch(std::size_t i) const {
+        prefetch_read(links_ + i);
+        prefetch_read(occupied_ + i / BITMAP_WORD_BITS);
+        prefetch_read(keys_ + i);
+        if constexpr (HashStorage::ENABLED) {
+            prefetch_read(hashes_ + i);
+        }
+    }
+
+    std::size_t next_occupied(std::size_t i) const {
+        return find_next_set(occupied_, size_, i);
+    }
+
+    // the largest free slot at or below i, or size() if there is none
+    std::size_t prev_free(std::size_t i) const {
+        return find_prev_clear(occupied_, size_, i);
+    }
+
+private:
+    std::size_t size_ = 0;
+    IndexType *links_ = nullptr;
+    std::uint64_t *occupied_ = nullptr;
+    RawStorage<KeyType> *keys_ = nullptr;
+    RawStorage<ValueType> *values_ = nullptr;
+    // stays null unless HashStorage stores hash codes
+    typename HashStorage::hash_type *hashes_ = nullptr;
+
+    // frees the arrays, elements have to be destroyed already
+    void deallocate_() {
+        deallocate_array(this->allocator_, links_, size_);
+        deallocate_array(this->allocator_, occupied_, bitmap_words(size_));
+        deallocate_array(this->allocator_, keys_, size_);
+        deallocate_array(this->allocator_, values_, size_);
+        deallocate_array(this->allocator_, hashes_, size_);
+        size_ = 0;
+        links_ = nullptr;
+        occupied_ = nullptr;
+        keys_ = nullptr;
+        values_ = nullptr;
+        hashes_ = nullptr;
+    }
+
+    // other has to use an equal allocator
+    void take_storage_(Table &other) noexcept {
+        std::swap(size_, other.size_);
+        std::swap(links_, other.links_);
+        std::swap(occupied_, other.occupied_);
+        std::swap(keys_, other.keys_);
+        std::swap(values_, other.values_);
+        std::swap(hashes_, other.hashes_);
+    }
+};
+
+
+// Read-only lookup interface over the arrays of a table stored in a snapshot.
+template<class KeyType, class ValueType, class IndexType, class HashStorage, class Allocator>
+class SplitLayout::Table<KeyType, ValueType, IndexType, HashStorage, Allocator>::View {
+public:
+    View() = default;
+
+    View(const void *const *arrays, std::size_t size)
+            : links_(static_cast<const IndexType *>(arrays[0])),
+              occupied_(static_cast<const std::uint64_t *>(arrays[1])),
+              keys_(static_cast<const RawStorage<KeyType> *>(arrays[2])),
+              values_(static_cast<const RawStorage<ValueType> *>(arrays[3])),
+              hashes_(static_cast<const typename HashStorage::hash_type *>(arrays[4])), size_(size) {}
+
+    std::size_t size() const {
+        return size_;
+    }
+
+    bool empty(std::size_t i) const {
+        return !test_bit(occupied_, i);
+    }
+
+    IndexType link(std::size_t i) const {
+        return links_[i];
+    }
+
+    const KeyType &key(std::size_t i) const {
+        return *keys_[i].get();
+    }
+
+    const_reference value(std::size_t i) const {
+        return const_reference(*keys_[i].get(), *values_[i].get());
+    }
+
+    const_pointer address(std::size_t i) const {
+        return const_pointer(value(i));
+    }
+
+    bool hash_matches(std::size_t i, std::size_t hash) const {
+        if constexpr (HashStorage::ENABLED) {
+            return hashes_[i] == static_cast<typename HashStorage::hash_type>(hash);
+        } else {
+            return true;
+        }
+    }
+
+    std::size_t next_occupied(std::size_t i) const {
+        return find_next_set(occupied_, size_, i);
+    }
+
+    // whether the bits past the last slot are clear, which the bitmap searches rely on
+    bool bitmap_ends_clear() const {
+        return size_ % BITMAP_WORD_BITS == 0 || occupied_[size_ / BITMAP_WORD_BITS] >> (size_ % BITMAP_WORD_BITS) == 0;
+    }
+
+private:
+    const IndexType *links_ = nullptr;
+    const std::uint64_t *occupied_ = nullptr;
+    const RawStorage<KeyType> *keys_ = nullptr;
+    const RawStorage<ValueType> *values_ = nullptr;
+    const typename HashStorage::hash_type *hashes_ = nullptr;
+    std::size_t size_ = 0;
+};
@@ -0,0 +1,508 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+
+#include "hashmap.h"
+#include "slot_layout.h"
+
+// A map that keeps up to N elements inside the object and looks them up by comparing keys one after another, which
+// beats hashing for a handful of keys and allocates nothing. The element that doesn't fit moves all of them into a
+// HashMap, and the map stays there until clear(). Keys are hashed only once they live in the HashMap.
+template<class KeyType, class ValueType, std::size_t N = 16, class Hash = std::hash<KeyType>>
+class SmallHashMap {
+    static_assert(N > 0, "N must be positive");
+
+public:
+    using Map = HashMap<KeyType, ValueType, Hash>;
+    using value_type = std::pair<const KeyType, ValueType>;
+
+    SmallHashMap(Hash hash_function = Hash());
+
+    SmallHashMap(std::initializer_list<std::pair<KeyType, ValueType>> init, Hash hash_function = Hash());
+
+    SmallHashMap(const SmallHashMap &other);
+
+    SmallHashMap(SmallHashMap &&other);
+
+    SmallHashMap &operator=(const SmallHashMap &other);
+
+    SmallHashMap &operator=(SmallHashMap &&other);
+
+    ~SmallHashMap();
+
+    std::size_t size() const;
+
+    bool empty() const;
+
+    Hash hash_function() const;
+
+    static constexpr std::size_t inline_capacity() {
+        return N;
+    }
+
+    // whether the elements are still stored inside the object
+    bool is_inline() const;
+
+    class iterator;
+
+    class const_iterator;
+
+    std::pair<iterator, bool> insert(const std::pair<KeyType, ValueType> &value);
+
+    std::pair<iterator, bool> insert(std::pair<KeyType, ValueType> &&value);
+
+    template<class... Args>
+    std::pair<iterator, bool> try_emplace(const KeyType &key, Args &&... args);
+
+    template<class... Args>
+    std::pair<iterator, bool> try_emplace(KeyType &&key, Args &&... args);
+
+    template<class M>
+    std::pair<iterator, bool> insert_or_assign(const KeyType &key, M &&obj);
+
+    void erase(const KeyType &key);
+
+    iterator find(const KeyType &key);
+
+    const_iterator find(const KeyType &key) const;
+
+    iterator begin();
+
+    iterator end();
+
+    const_iterator begin() const;
+
+    const_iterator end() const;
+
+    ValueType &operator[](const KeyType &key);
+
+    ValueType &operator[](KeyType &&key);
+
+    const ValueType &at(const KeyType &key) const;
+
+    void clear();
+
+    void reserve(std::size_t n);
+
+private:
+    using Allocator = std::allocator<value_type>;
+
+    Allocator allocator_;
+    RawStorage<value_type> elements_[N];
+    std::size_t inline_size_ = 0;
+    bool inline_ = true;
+    // empty, and without any slots, while the elements are inline
+    Map map_;
+
+    std::size_t find_inline_(const KeyType &key) const;
+
+    template<class K, class... Args>
+    std::pair<iterator, bool> try_emplace_(K &&key, Args &&... args);
+
+    void spill_(std::size_t n);
+
+    void destroy_inline_();
+};
+
+
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+SmallHashMap<KeyType, ValueType, N, Hash>::SmallHashMap(Hash hash_function) : map_(hash_function) {}
+
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+SmallHashMap<KeyType, ValueType, N, Hash>::SmallHashMap(std::initializer_list<std::pair<KeyType, ValueType>> init,
+                                                        Hash hash_function) : map_(hash_function) {
+    reserve(init.size());
+    for (const std::pair<KeyType, ValueType> &value : init) {
+        insert(value);
+    }
+}
+
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+SmallHashMap<KeyType, ValueType, N, Hash>::SmallHashMap(const SmallHashMap &other)
+        : inline_(other.inline_), map_(other.map_) {
+    try {
+        for (; inline_size_ < other.inline_size_; ++inline_size_) {
+            elements_[inline_size_].construct(allocator_, *other.elements_[inline_size_].get());
+        }
+    } catch (...) {
+        destroy_inline_();
+        throw;
+    }
+}
+
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+SmallHashMap<KeyType, ValueType, N, Hash>::SmallHashMap(SmallHashMap &&other)
+        : inline_(other.inline_), map_(std::move(other.map_)) {
+    // inline elements can't change hands, their values are moved and their keys copied
+    try {
+        for (; inline_size_ < other.inline_size_; ++inline_size_) {
+            elements_[inline_size_].construct(allocator_, std::move(*other.elements_[inline_size_].get()));
+        }
+    } catch (...) {
+        destroy_inline_();
+        throw;
+    }
+    other.clear();
+}
+
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+SmallHashMap<KeyType, ValueType, N, Hash> &SmallHashMap<KeyType, ValueType, N, Hash>::operator=(const SmallHashMap &other) {
+    if (this != &other) {
+        *this = SmallHashMap(other);
+    }
+    return *this;
+}
+
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+SmallHashMap<KeyType, ValueType, N, Hash> &SmallHashMap<KeyType, ValueType, N, Hash>::operator=(SmallHashMap &&other) {
+    if (this == &other) {
+        return *this;
+    }
+    clear();
+    for (; inline_size_ < other.inline_size_; ++inline_size_) {
+        elements_[inline_size_].construct(allocator_, std::move(*other.elements_[inline_size_].get()));
+    }
+    inline_ = other.inline_;
+    map_ = std::move(other.map_);
+    other.clear();
+    return *this;
+}
+
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+SmallHashMap<KeyType, ValueType, N, Hash>::~SmallHashMap() {
+    destroy_inline_();
+}
+
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+std::size_t SmallHashMap<KeyType, ValueType, N, Hash>::size() const {
+    return inline_ ? inline_size_ : map_.size();
+}
+
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+bool SmallHashMap<KeyType, ValueType, N, Hash>::empty() const {
+    return size() == 0;
+}
+
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+Hash SmallHashMap<KeyType, ValueType, N, Hash>::hash_function() const {
+    return map_.hash_function();
+}
+
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+bool SmallHashMap<KeyType, ValueType, N, Hash>::is_inline() const {
+    return inline_;
+}
+
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+std::pair<typename SmallHashMap<KeyType, ValueType, N, Hash>::iterator, bool>
+SmallHashMap<KeyType, ValueType, N, Hash>::insert(const std::pair<KeyType, ValueType> &value) {
+    return try_emplace_(value.first, value.second);
+}
+
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+std::pair<typename SmallHashMap<KeyType, ValueType, N, Hash>::iterator, bool>
+SmallHashMap<KeyType, ValueType, N, Hash>::insert(std::pair<KeyType, ValueType> &&value) {
+    return try_emplace_(std::move(value.first), std::move(value.second));
+}
+
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+template<class... Args>
+std::pair<typename SmallHashMap<KeyType, ValueType, N, Hash>::iterator, bool>
+SmallHashMap<KeyType, ValueType, N, Hash>::try_emplace(const KeyType &key, Args &&... args) {
+    return try_emplace_(key, std::forward<Args>(args)...);
+}
+
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+template<class... Args>
+std::pair<typename SmallHashMap<KeyType, ValueType, N, Hash>::iterator, bool>
+SmallHashMap<KeyType, ValueType, N, Hash>::try_emplace(KeyType &&key, Args &&... args) {
+    return try_emplace_(std::move(key), std::forward<Args>(args)...);
+}
+
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+template<class M>
+std::pair<typename SmallHashMap<KeyType, ValueType, N, Hash>::iterator, bool>
+SmallHashMap<KeyType, ValueType, N, Hash>::insert_or_assign(const KeyType &key, M &&obj) {
+    std::pair<iterator, bool> result = try_emplace_(key, std::forward<M>(obj));
+    if (!result.second) {
+        result.first->second = std::forward<M>(obj);
+    }
+    return result;
+}
+
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+void SmallHashMap<KeyType, ValueType, N, Hash>::erase(const KeyType &key) {
+    if (!inline_) {
+        map_.erase(key);
+        return;
+    }
+    std::size_t k = find_inline_(key);
+    if (k == inline_size_) {
+        return;
+    }
+    // the last element fills the gap
+    elements_[k].destroy(allocator_);
+    --inline_size_;
+    if (k != inline_size_) {
+        relocate(elements_[k], elements_[inline_size_], allocator_);
+    }
+}
+
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+typename SmallHashMap<KeyType, ValueType, N, Hash>::iterator
+SmallHashMap<KeyType, ValueType, N, Hash>::find(const KeyType &key) {
+    if (!inline_) {
+        return iterator(map_.find(key));
+    }
+    return iterator(elements_ + find_inline_(key));
+}
+
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+typename SmallHashMap<KeyType, ValueType, N, Hash>::const_iterator
+SmallHashMap<KeyType, ValueType, N, Hash>::find(const KeyType &key) const {
+    if (!inline_) {
+        return const_iterator(map_.find(key));
+    }
+    return const_iterator(elements_ + find_inline_(key));
+}
+
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+typename SmallHashMap<KeyType, ValueType, N, Hash>::iterator SmallHashMap<KeyType, ValueType, N, Hash>::begin() {
+    return inline_ ? iterator(elements_) : iterator(map_.begin());
+}
+
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+typename SmallHashMap<KeyType, ValueType, N, Hash>::iterator SmallHashMap<KeyType, ValueType, N, Hash>::end() {
+    return inline_ ? iterator(elements_ + inline_size_) : iterator(map_.end());
+}
+
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+typename SmallHashMap<KeyType, ValueType, N, Hash>::const_iterator
+SmallHashMap<KeyType, ValueType, N, Hash>::begin() const {
+    return inline_ ? const_iterator(elements_) : const_iterator(map_.begin());
+}
+
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+typename SmallHashMap<KeyType, ValueType, N, Hash>::const_iterator
+SmallHashMap<KeyType, ValueType, N, Hash>::end() const {
+    return inline_ ? const_iterator(elements_ + inline_size_) : const_iterator(map_.end());
+}
+
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+ValueType &SmallHashMap<KeyType, ValueType, N, Hash>::operator[](const KeyType &key) {
+    return try_emplace_(key).first->second;
+}
+
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+ValueType &SmallHashMap<KeyType, ValueType, N, Hash>::operator[](KeyType &&key) {
+    return try_emplace_(std::move(key)).first->second;
+}
+
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+const ValueType &SmallHashMap<KeyType, ValueType, N, Hash>::at(const KeyType &key) const {
+    const_iterator it = find(key);
+    if (it != end()) {
+        return it->second;
+    }
+    throw std::out_of_range("");
+}
+
+// returns to inline storage and frees the slots of the HashMap
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+void SmallHashMap<KeyType, ValueType, N, Hash>::clear() {
+    destroy_inline_();
+    if (!inline_) {
+        Map(map_.hash_function()).swap(map_);
+        inline_ = true;
+    }
+}
+
+// moves the elements into the HashMap right away if n of them won't fit inline
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+void SmallHashMap<KeyType, ValueType, N, Hash>::reserve(std::size_t n) {
+    if (!inline_) {
+        map_.reserve(n);
+    } else if (n > N) {
+        spill_(n);
+        map_.reserve(n);
+    }
+}
+
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+std::size_t SmallHashMap<KeyType, ValueType, N, Hash>::find_inline_(const KeyType &key) const {
+    std::size_t k = 0;
+    while (k < inline_size_ && !(elements_[k].get()->first == key)) {
+        ++k;
+    }
+    return k;
+}
+
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+template<class K, class... Args>
+std::pair<typename SmallHashMap<KeyType, ValueType, N, Hash>::iterator, bool>
+SmallHashMap<KeyType, ValueType, N, Hash>::try_emplace_(K &&key, Args &&... args) {
+    if (!inline_) {
+        std::pair<typename Map::iterator, bool> result = map_.try_emplace(std::forward<K>(key),
+                                                                          std::forward<Args>(args)...);
+        return std::make_pair(iterator(result.first), result.second);
+    }
+
+    std::size_t k = find_inline_(key);
+    if (k != inline_size_) {
+        return std::make_pair(iterator(elements_ + k), false);
+    }
+    if (inline_size_ < N) {
+        elements_[k].construct(allocator_, std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+                               std::forward_as_tuple(std::forward<Args>(args)...));
+        ++inline_size_;
+        return std::make_pair(iterator(elements_ + k), true);
+    }
+
+    // built before the elements move, because the arguments may refer to them
+    std::pair<KeyType, ValueType> value(std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+                                        std::forward_as_tuple(std::forward<Args>(args)...));
+    spill_(2 * N);
+    std::pair<typename Map::iterator, bool> result = map_.try_emplace(std::move(value.first),
+                                                                      std::move(value.second));
+    return std::make_pair(iterator(result.first), result.second);
+}
+
+// moves the inline elements into the HashMap sized for n elements. If that throws, the elements stay inline,
+// though values that were moved already are left moved-from.
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+void SmallHashMap<KeyType, ValueType, N, Hash>::spill_(std::size_t n) {
+    try {
+        map_.rehash(static_cast<std::size_t>(n / map_.max_load_factor()) + 1);
+        for (std::size_t k = 0; k < inline_size_; ++k) {
+            value_type &element = *elements_[k].get();
+            map_.try_emplace(element.first, std::move(element.second));
+        }
+    } catch (...) {
+        Map(map_.hash_function()).swap(map_);
+        throw;
+    }
+    destroy_inline_();
+    inline_ = false;
+}
+
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+void SmallHashMap<KeyType, ValueType, N, Hash>::destroy_inline_() {
+    for (std::size_t k = 0; k < inline_size_; ++k) {
+        elements_[k].destroy(allocator_);
+    }
+    inline_size_ = 0;
+}
+
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+class SmallHashMap<KeyType, ValueType, N, Hash>::iterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::pair<const KeyType, ValueType>;
+    using difference_type = std::ptrdiff_t;
+    using reference = value_type &;
+    using pointer = value_type *;
+
+    iterator() = default;
+
+    iterator &operator++() {
+        if (element_ != nullptr) {
+            ++element_;
+        } else {
+            ++it_;
+        }
+        return *this;
+    }
+
+    iterator operator++(int) {
+        iterator ret_it = *this;
+        ++(*this);
+        return ret_it;
+    }
+
+    bool operator==(const iterator &other) const {
+        return element_ == other.element_ && it_ == other.it_;
+    }
+
+    bool operator!=(const iterator &other) const {
+        return !(*this == other);
+    }
+
+    reference operator*() const {
+        return element_ != nullptr ? *element_->get() : *it_;
+    }
+
+    pointer operator->() const {
+        return &**this;
+    }
+
+private:
+    friend class SmallHashMap;
+
+    // inline elements are visited through element_, elements of the HashMap through it_
+    RawStorage<value_type> *element_ = nullptr;
+    typename Map::iterator it_;
+
+    explicit iterator(RawStorage<value_type> *element) : element_(element) {}
+
+    explicit iterator(typename Map::iterator it) : it_(it) {}
+};
+
+template<class KeyType, class ValueType, std::size_t N, class Hash>
+class SmallHashMap<KeyType, ValueType, N, Hash>::const_iterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::pair<const KeyType, ValueType>;
+    using difference_type = std::ptrdiff_t;
+    using reference = const value_type &;
+    using pointer = const value_type *;
+
+    const_iterator() = default;
+
+    const_iterator &operator++() {
+        if (element_ != nullptr) {
+            ++element_;
+        } else {
+            ++it_;
+        }
+        return *this;
+    }
+
+    const_iterator operator++(int) {
+        const_iterator ret_it = *this;
+        ++(*this);
+        return ret_it;
+    }
+
+    bool operator==(const const_iterator &other) const {
+        return element_ == other.element_ && it_ == other.it_;
+    }
+
+    bool operator!=(const const_iterator &other) const {
+        return !(*this == other);
+    }
+
+    reference operator*() const {
+        return element_ != nullptr ? *element_->get() : *it_;
+    }
+
+    pointer operator->() const {
+        return &**this;
+    }
+
+private:
+    friend class SmallHashMap;
+
+    const RawStorage<value_type> *element_ = nullptr;
+    typename Map::const_iterator it_;
+
+    explicit const_iterator(const RawStorage<value_type> *element) : element_(element) {}
+
+    explicit const_iterator(typename Map::const_iterator it) : it_(it) {}
+};
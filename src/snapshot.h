@@ -0,0 +1,197 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Snapshot files hold the arrays of one table as they are in memory, behind a header that describes the map type
+// they belong to. Links are slot indices and not pointers, so a table of trivially copyable keys and values can be
+// used right where the file is mapped. Arrays start at multiples of SNAPSHOT_ALIGNMENT bytes, which keeps them
+// aligned in a page-aligned mapping.
+
+constexpr std::uint32_t SNAPSHOT_VERSION = 2;
+constexpr std::uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+constexpr std::size_t SNAPSHOT_MAX_ARRAYS = 8;
+constexpr std::size_t SNAPSHOT_ALIGNMENT = 64;
+
+struct SnapshotHeader {
+    char magic[8];
+    std::uint32_t byte_order;
+    std::uint32_t version;
+    std::uint32_t layout;
+    std::uint32_t arrays_size;
+    std::uint64_t key_bytes;
+    std::uint64_t value_bytes;
+    std::uint64_t index_bytes;
+    std::uint64_t hash_bytes;
+    std::uint64_t slot_count;
+    std::uint64_t address_size;
+    std::uint64_t size;
+    // the hash code of a value-initialized key, which tells apart hash functions and seeds
+    std::uint64_t hash_check;
+    // hash addresses of fixed hash codes, which tell apart indexers
+    std::uint64_t indexer_check;
+    std::uint64_t offsets[SNAPSHOT_MAX_ARRAYS];
+    std::uint64_t bytes[SNAPSHOT_MAX_ARRAYS];
+};
+
+inline const char *snapshot_magic() {
+    return "CHMSNAP";
+}
+
+// The header of a snapshot of a table with the given sizes, without array offsets.
+template<class Table, class KeyType, class ValueType, class IndexType, class Indexer, class HashStorage, class Hash>
+SnapshotHeader snapshot_header(std::size_t slot_count, std::size_t address_size, std::size_t size,
+                               const Hash &hash_function) {
+    static_assert(Table::SNAPSHOT_ARRAYS <= SNAPSHOT_MAX_ARRAYS, "too many arrays for a snapshot");
+
+    SnapshotHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, snapshot_magic(), sizeof(header.magic));
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.version = SNAPSHOT_VERSION;
+    header.layout = Table::SNAPSHOT_LAYOUT;
+    header.arrays_size = static_cast<std::uint32_t>(Table::SNAPSHOT_ARRAYS);
+    header.key_bytes = sizeof(KeyType);
+    header.value_bytes = sizeof(ValueType);
+    header.index_bytes = sizeof(IndexType);
+    header.hash_bytes = HashStorage::ENABLED ? sizeof(typename HashStorage::hash_type) : 0;
+    header.slot_count = slot_count;
+    header.address_size = address_size;
+    header.size = size;
+    if constexpr (std::is_default_constructible<KeyType>::value) {
+        header.hash_check = hash_function(KeyType());
+    }
+    if (address_size != 0) {
+        for (std::uint64_t hash : {0x0123456789abcdefULL, 0xfedcba9876543210ULL, 0x9e3779b97f4a7c15ULL}) {
+            header.indexer_check = header.indexer_check * 31 + Indexer::index(static_cast<std::size_t>(hash),
+                                                                              address_size);
+        }
+    }
+    Table::snapshot_bytes(slot_count, header.bytes);
+    return header;
+}
+
+// Writes header and arrays to path, laying the arrays out as the mapping expects.
+inline void write_snapshot(const std::string &path, SnapshotHeader header, const void *const *arrays) {
+    std::uint64_t offset = (sizeof(SnapshotHeader) + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+    for (std::size_t k = 0; k < header.arrays_size; ++k) {
+        header.offsets[k] = offset;
+        offset += (header.bytes[k] + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+    }
+
+    std::FILE *file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        throw std::runtime_error("can't open snapshot " + path);
+    }
+    static const char padding[SNAPSHOT_ALIGNMENT] = {};
+    bool written = std::fwrite(&header, sizeof(header), 1, file) == 1;
+    std::uint64_t position = sizeof(header);
+    for (std::size_t k = 0; k < header.arrays_size && written; ++k) {
+        written = std::fwrite(padding, 1, header.offsets[k] - position, file) == header.offsets[k] - position &&
+                  (header.bytes[k] == 0 || std::fwrite(arrays[k], header.bytes[k], 1, file) == 1);
+        position = header.offsets[k] + header.bytes[k];
+    }
+    if (std::fclose(file) != 0 || !written) {
+        throw std::runtime_error("can't write snapshot " + path);
+    }
+}
+
+// A read-only mapping of a whole file. Systems without mmap read the file into memory instead.
+class SnapshotMapping {
+public:
+    SnapshotMapping() = default;
+
+    explicit SnapshotMapping(const std::string &path) {
+#if defined(__unix__) || defined(__APPLE__)
+        int file = ::open(path.c_str(), O_RDONLY);
+        if (file < 0) {
+            throw std::runtime_error("can't open snapshot " + path);
+        }
+        struct stat status;
+        if (::fstat(file, &status) != 0) {
+            ::close(file);
+            throw std::runtime_error("can't read snapshot " + path);
+        }
+        size_ = static_cast<std::size_t>(status.st_size);
+        void *data = size_ == 0 ? nullptr : ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, file, 0);
+        ::close(file);
+        if (data == MAP_FAILED) {
+            throw std::runtime_error("can't map snapshot " + path);
+        }
+        data_ = static_cast<const unsigned char *>(data);
+#else
+        std::FILE *file = std::fopen(path.c_str(), "rb");
+        if (file == nullptr) {
+            throw std::runtime_error("can't open snapshot " + path);
+        }
+        std::fseek(file, 0, SEEK_END);
+        long size = std::ftell(file);
+        std::fseek(file, 0, SEEK_SET);
+        size_ = size < 0 ? 0 : static_cast<std::size_t>(size);
+        void *data = ::operator new(size_, std::align_val_t(SNAPSHOT_ALIGNMENT));
+        bool read = size >= 0 && std::fread(data, 1, size_, file) == size_;
+        std::fclose(file);
+        if (!read) {
+            ::operator delete(data, std::align_val_t(SNAPSHOT_ALIGNMENT));
+            throw std::runtime_error("can't read snapshot " + path);
+        }
+        data_ = static_cast<const unsigned char *>(data);
+#endif
+    }
+
+    SnapshotMapping(SnapshotMapping &&other) noexcept : data_(other.data_), size_(other.size_) {
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+
+    SnapshotMapping &operator=(SnapshotMapping &&other) noexcept {
+        if (this != &other) {
+            unmap_();
+            data_ = other.data_;
+            size_ = other.size_;
+            other.data_ = nullptr;
+            other.size_ = 0;
+        }
+        return *this;
+    }
+
+    ~SnapshotMapping() {
+        unmap_();
+    }
+
+    const unsigned char *data() const {
+        return data_;
+    }
+
+    std::size_t size() const {
+        return size_;
+    }
+
+private:
+    const unsigned char *data_ = nullptr;
+    std::size_t size_ = 0;
+
+    void unmap_() {
+        if (data_ == nullptr) {
+            return;
+        }
+#if defined(__unix__) || defined(__APPLE__)
+        ::munmap(const_cast<unsigned char *>(data_), size_);
+#else
+        ::operator delete(const_cast<unsigned char *>(data_), std::align_val_t(SNAPSHOT_ALIGNMENT));
+#endif
+    }
+};
@@ -0,0 +1,305 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "slot_indexer.h"
+
+// A read-only map of fixed contents that is laid out at compile time. The slots and their links live in a std::array
+// inside the object, so a constexpr StaticHashMap costs nothing at startup and ends up in read-only data. The table is
+// built like HashMap::build() lays out a table: elements first take their free hash addresses, and the remaining ones
+// take free slots from the top of the table and are linked to the end of their chains. Building also tries
+// SEED_TRIES hash seeds and keeps the first one under which no two keys share a hash address. With enough slots that
+// is a perfect hash; otherwise the seed with the fewest shared addresses is kept.
+//
+// Hash has to be callable in constant expressions and constructible from a std::uint64_t seed.
+
+// A seedable hash for constant expressions. Integers and enums are mixed, anything convertible to std::string_view
+// is hashed with FNV-1a.
+struct StaticHash {
+    std::uint64_t seed = 0;
+
+    constexpr StaticHash() = default;
+
+    constexpr explicit StaticHash(std::uint64_t seed) : seed(seed) {}
+
+    template<class T>
+    constexpr std::size_t operator()(const T &key) const {
+        if constexpr (std::is_integral<T>::value || std::is_enum<T>::value) {
+            return static_cast<std::size_t>(mix_hash(static_cast<std::uint64_t>(key) + seed * 0x9e3779b97f4a7c15ULL));
+        } else {
+            static_assert(std::is_convertible<const T &, std::string_view>::value,
+                          "StaticHash hashes integers, enums and strings");
+            std::string_view bytes = key;
+            std::uint64_t hash = 0xcbf29ce484222325ULL ^ mix_hash(seed);
+            for (char c : bytes) {
+                hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+            }
+            return static_cast<std::size_t>(mix_hash(hash));
+        }
+    }
+};
+
+template<class KeyType, class ValueType, std::size_t N, std::size_t SlotCount = N, class Hash = StaticHash,
+        class Indexer = ModuloIndexer>
+class StaticHashMap {
+    static_assert(N > 0, "a static map holds at least one element");
+    static_assert(SlotCount >= N, "a static map needs a slot for every element");
+
+public:
+    using value_type = std::pair<KeyType, ValueType>;
+    using IndexType = std::uint32_t;
+
+    // seeds tried while building, 0 to SEED_TRIES - 1
+    static constexpr std::uint64_t SEED_TRIES = 64;
+
+    // duplicate keys throw std::invalid_argument, which fails compilation when the map is built in a constant expression
+    constexpr explicit StaticHashMap(const value_type (&elements)[N]);
+
+    constexpr std::size_t size() const;
+
+    constexpr bool empty() const;
+
+    constexpr Hash hash_function() const;
+
+    static constexpr std::size_t slot_count() {
+        return ADDRESS_SIZE;
+    }
+
+    // whether every element sits at its hash address, so each lookup probes one slot
+    constexpr bool perfect() const;
+
+    class const_iterator;
+
+    constexpr const_iterator begin() const;
+
+    constexpr const_iterator end() const;
+
+    constexpr const_iterator find(const KeyType &key) const;
+
+    constexpr const ValueType &at(const KeyType &key) const;
+
+private:
+    // the indexer may round the slot count up, every slot is a hash address
+    static constexpr std::size_t ADDRESS_SIZE = Indexer::address_size(SlotCount);
+    static constexpr IndexType NULL_INDEX = std::numeric_limits<IndexType>::max();
+
+    static_assert(ADDRESS_SIZE < NULL_INDEX, "too many slots for IndexType");
+
+    struct Slot {
+        value_type element{};
+        IndexType link = NULL_INDEX;
+        bool occupied = false;
+    };
+
+    std::array<Slot, ADDRESS_SIZE> slots_{};
+    Hash hash_function_{};
+    std::size_t displaced_ = 0;
+
+    // elements whose hash address an earlier element already takes under hash_function
+    static constexpr std::size_t count_collisions_(const value_type (&elements)[N], const Hash &hash_function);
+
+    constexpr void place_(const value_type (&elements)[N]);
+
+    constexpr std::size_t find_index_(const KeyType &key) const;
+
+    constexpr std::size_t next_occupied_(std::size_t i) const;
+};
+
+// Builds a StaticHashMap of the given pairs, with as many slots as pairs unless SlotCount asks for more, e.g.
+// constexpr auto opcodes = make_static_hashmap<std::string_view, int>({{"add", 1}, {"sub", 2}});
+template<class KeyType, class ValueType, std::size_t SlotCount = 0, class Hash = StaticHash, std::size_t N>
+constexpr StaticHashMap<KeyType, ValueType, N, SlotCount == 0 ? N : SlotCount, Hash>
+make_static_hashmap(const std::pair<KeyType, ValueType> (&elements)[N]) {
+    return StaticHashMap<KeyType, ValueType, N, SlotCount == 0 ? N : SlotCount, Hash>(elements);
+}
+
+
+template<class KeyType, class ValueType, std::size_t N, std::size_t SlotCount, class Hash, class Indexer>
+constexpr StaticHashMap<KeyType, ValueType, N, SlotCount, Hash, Indexer>::StaticHashMap(const value_type (&elements)[N]) {
+    std::size_t fewest_collisions = N;
+    for (std::uint64_t seed = 0; seed < SEED_TRIES && fewest_collisions != 0; ++seed) {
+        std::size_t collisions = count_collisions_(elements, Hash(seed));
+        if (collisions < fewest_collisions || seed == 0) {
+            fewest_collisions = collisions;
+            hash_function_ = Hash(seed);
+        }
+    }
+    place_(elements);
+}
+
+template<class KeyType, class ValueType, std::size_t N, std::size_t SlotCount, class Hash, class Indexer>
+constexpr std::size_t StaticHashMap<KeyType, ValueType, N, SlotCount, Hash, Indexer>::size() const {
+    return N;
+}
+
+template<class KeyType, class ValueType, std::size_t N, std::size_t SlotCount, class Hash, class Indexer>
+constexpr bool StaticHashMap<KeyType, ValueType, N, SlotCount, Hash, Indexer>::empty() const {
+    return false;
+}
+
+template<class KeyType, class ValueType, std::size_t N, std::size_t SlotCount, class Hash, class Indexer>
+constexpr Hash StaticHashMap<KeyType, ValueType, N, SlotCount, Hash, Indexer>::hash_function() const {
+    return hash_function_;
+}
+
+template<class KeyType, class ValueType, std::size_t N, std::size_t SlotCount, class Hash, class Indexer>
+constexpr bool StaticHashMap<KeyType, ValueType, N, SlotCount, Hash, Indexer>::perfect() const {
+    return displaced_ == 0;
+}
+
+template<class KeyType, class ValueType, std::size_t N, std::size_t SlotCount, class Hash, class Indexer>
+constexpr typename StaticHashMap<KeyType, ValueType, N, SlotCount, Hash, Indexer>::const_iterator
+StaticHashMap<KeyType, ValueType, N, SlotCount, Hash, Indexer>::begin() const {
+    return const_iterator(next_occupied_(0), this);
+}
+
+template<class KeyType, class ValueType, std::size_t N, std::size_t SlotCount, class Hash, class Indexer>
+constexpr typename StaticHashMap<KeyType, ValueType, N, SlotCount, Hash, Indexer>::const_iterator
+StaticHashMap<KeyType, ValueType, N, SlotCount, Hash, Indexer>::end() const {
+    return const_iterator(ADDRESS_SIZE, this);
+}
+
+template<class KeyType, class ValueType, std::size_t N, std::size_t SlotCount, class Hash, class Indexer>
+constexpr typename StaticHashMap<KeyType, ValueType, N, SlotCount, Hash, Indexer>::const_iterator
+StaticHashMap<KeyType, ValueType, N, SlotCount, Hash, Indexer>::find(const KeyType &key) const {
+    return const_iterator(find_index_(key), this);
+}
+
+template<class KeyType, class ValueType, std::size_t N, std::size_t SlotCount, class Hash, class Indexer>
+constexpr const ValueType &StaticHashMap<KeyType, ValueType, N, SlotCount, Hash, Indexer>::at(const KeyType &key) const {
+    std::size_t i = find_index_(key);
+    if (i != ADDRESS_SIZE) {
+        return slots_[i].element.second;
+    }
+    throw std::out_of_range("");
+}
+
+template<class KeyType, class ValueType, std::size_t N, std::size_t SlotCount, class Hash, class Indexer>
+constexpr std::size_t StaticHashMap<KeyType, ValueType, N, SlotCount, Hash, Indexer>::count_collisions_(
+        const value_type (&elements)[N], const Hash &hash_function) {
+    std::array<bool, ADDRESS_SIZE> taken{};
+    std::size_t collisions = 0;
+    for (const value_type &element : elements) {
+        std::size_t home = Indexer::index(hash_function(element.first), ADDRESS_SIZE);
+        collisions += taken[home];
+        taken[home] = true;
+    }
+    return collisions;
+}
+
+template<class KeyType, class ValueType, std::size_t N, std::size_t SlotCount, class Hash, class Indexer>
+constexpr void StaticHashMap<KeyType, ValueType, N, SlotCount, Hash, Indexer>::place_(const value_type (&elements)[N]) {
+    // the first pass keeps every hash address that some element has for that element
+    std::array<std::size_t, N> deferred{};
+    std::size_t deferred_size = 0;
+    for (std::size_t k = 0; k < N; ++k) {
+        std::size_t home = Indexer::index(hash_function_(elements[k].first), ADDRESS_SIZE);
+        if (slots_[home].occupied) {
+            deferred[deferred_size++] = k;
+            continue;
+        }
+        // assigned member by member, std::pair only gets a constexpr assignment in C++20
+        slots_[home].element.first = elements[k].first;
+        slots_[home].element.second = elements[k].second;
+        slots_[home].occupied = true;
+    }
+
+    std::size_t largest_empty = ADDRESS_SIZE;
+    for (std::size_t d = 0; d < deferred_size; ++d) {
+        const value_type &element = elements[deferred[d]];
+        std::size_t tail = Indexer::index(hash_function_(element.first), ADDRESS_SIZE);
+        while (true) {
+            if (slots_[tail].element.first == element.first) {
+                throw std::invalid_argument("duplicate key in a static map");
+            }
+            if (slots_[tail].link == NULL_INDEX) {
+                break;
+            }
+            tail = slots_[tail].link;
+        }
+        do {
+            --largest_empty;
+        } while (slots_[largest_empty].occupied);
+        slots_[largest_empty].element.first = element.first;
+        slots_[largest_empty].element.second = element.second;
+        slots_[largest_empty].occupied = true;
+        slots_[tail].link = static_cast<IndexType>(largest_empty);
+    }
+    displaced_ = deferred_size;
+}
+
+template<class KeyType, class ValueType, std::size_t N, std::size_t SlotCount, class Hash, class Indexer>
+constexpr std::size_t StaticHashMap<KeyType, ValueType, N, SlotCount, Hash, Indexer>::find_index_(const KeyType &key) const {
+    std::size_t i = Indexer::index(hash_function_(key), ADDRESS_SIZE);
+    if (!slots_[i].occupied) {
+        return ADDRESS_SIZE;
+    }
+    while (!(slots_[i].element.first == key)) {
+        if (slots_[i].link == NULL_INDEX) {
+            return ADDRESS_SIZE;
+        }
+        i = slots_[i].link;
+    }
+    return i;
+}
+
+template<class KeyType, class ValueType, std::size_t N, std::size_t SlotCount, class Hash, class Indexer>
+constexpr std::size_t StaticHashMap<KeyType, ValueType, N, SlotCount, Hash, Indexer>::next_occupied_(std::size_t i) const {
+    while (i < ADDRESS_SIZE && !slots_[i].occupied) {
+        ++i;
+    }
+    return i;
+}
+
+template<class KeyType, class ValueType, std::size_t N, std::size_t SlotCount, class Hash, class Indexer>
+class StaticHashMap<KeyType, ValueType, N, SlotCount, Hash, Indexer>::const_iterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::pair<KeyType, ValueType>;
+    using difference_type = std::ptrdiff_t;
+    using reference = const value_type &;
+    using pointer = const value_type *;
+
+    constexpr const_iterator() = default;
+
+    constexpr const_iterator(std::size_t index, const StaticHashMap *map) : index_(index), map_(map) {}
+
+    constexpr const_iterator &operator++() {
+        index_ = map_->next_occupied_(index_ + 1);
+        return *this;
+    }
+
+    constexpr const_iterator operator++(int) {
+        const_iterator ret_it = *this;
+        ++(*this);
+        return ret_it;
+    }
+
+    constexpr bool operator==(const const_iterator &other) const {
+        return index_ == other.index_ && map_ == other.map_;
+    }
+
+    constexpr bool operator!=(const const_iterator &other) const {
+        return !(*this == other);
+    }
+
+    constexpr reference operator*() const {
+        return map_->slots_[index_].element;
+    }
+
+    constexpr pointer operator->() const {
+        return &map_->slots_[index_].element;
+    }
+
+private:
+    std::size_t index_ = 0;
+    const StaticHashMap *map_ = nullptr;
+};
@@ -1,9 +1,28 @@
 #include "../src/hashmap.h"
+#include "../src/concurrent_hashmap.h"
+#include "../src/sharded_hashmap.h"
+#include "../src/small_hashmap.h"
+#include "../src/static_hashmap.h"
+#include "../src/lru_cache.h"
+#include "../src/paged_layout.h"
 #include <iostream>
 #include <cstdlib>
 #include <functional>
 #include <stdexcept>
 #include <map>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <string_view>
+#include <string>
+#include <memory_resource>
+#include <memory>
+#include <cstdio>
+#include <sstream>
+#include <fstream>
+#include <iterator>
+#include <cstring>
+#include <algorithm>
 
 void fail(const char *message) {
     std::cerr << "Fail:\n";
@@ -257,6 +276,1769 @@ namespace internal_tests {
         std::cerr << "ok!\n";
     }
 
+/* check that incremental rehash keeps every element reachable while migrating */
+    void check_incremental_rehash() {
+        std::cerr << "check incremental rehash...\n";
+        HashMap<int, int> map;
+        map.incremental_rehash(true);
+        bool was_rehashing = false;
+        for (int i = 0; i < 5000; ++i) {
+            map[i] = i;
+            was_rehashing |= map.rehashing();
+            if (map.find(i / 2) == map.end() || map.find(i / 2)->second != i / 2)
+                fail("element lost during migration");
+        }
+        if (!was_rehashing)
+            fail("incremental rehash never started");
+        for (int i = 0; i < 5000; i += 2)
+            map.erase(i);
+        if (map.size() != 2500)
+            fail("wrong size");
+        std::size_t count = 0;
+        for (auto cur : map) {
+            if (cur.first % 2 == 0)
+                fail("erased element is still iterated");
+            ++count;
+        }
+        if (count != 2500)
+            fail("wrong number of iterated elements");
+        while (map.rehash_step(64)) {
+        }
+        if (map.rehashing() || map.at(4999) != 4999)
+            fail("incorrect rehash_step");
+        std::cerr << "ok!\n";
+    }
+
+/* check that reserve, rehash and the load factor setters control capacity */
+    void check_capacity() {
+        std::cerr << "check capacity control...\n";
+        HashMap<int, int> map;
+        map.reserve(10000);
+        std::size_t reserved = map.slot_count();
+        if (reserved * map.max_load_factor() < 10000)
+            fail("reserve doesn't fit requested elements");
+        for (int i = 0; i < 10000; ++i)
+            map[i] = i;
+        for (int i = 0; i < 10000; ++i)
+            map.erase(i);
+        if (map.slot_count() != reserved)
+            fail("rehash after reserve");
+        map.shrink_to_fit();
+        if (map.slot_count() >= reserved)
+            fail("shrink_to_fit doesn't shrink");
+
+        map.auto_shrink(false);
+        map.rehash(4096);
+        if (map.slot_count() != 4096)
+            fail("wrong rehash");
+        map.insert(std::make_pair(1, 1));
+        map.erase(1);
+        if (map.slot_count() != 4096)
+            fail("shrinks with auto_shrink disabled");
+
+        try {
+            map.max_load_factor(1.5);
+            fail("max load factor above 1 accepted");
+        }
+        catch (const std::invalid_argument& e) {
+        }
+        map.min_load_factor(0.1);
+        map.max_load_factor(0.5);
+        for (int i = 0; i < 3000; ++i)
+            map[i] = i;
+        if (map.load_factor() > 0.5)
+            fail("max load factor is ignored");
+        std::cerr << "ok!\n";
+    }
+
+/* check that the split layout behaves like the interleaved one */
+    void check_split_layout() {
+        std::cerr << "check split layout...\n";
+        HashMap<int, std::string, std::hash<int>, SplitLayout> map{{1, "a"}, {2, "b"}};
+        static_assert(std::is_same<
+                const int,
+                std::remove_reference<decltype(map.begin()->first)>::type
+        >::value, "Iterator's key type isn't const");
+        for (int i = 0; i < 3000; ++i)
+            map[i] += "x";
+        for (int i = 0; i < 3000; i += 3)
+            map.erase(i);
+        if (map.size() != 2000)
+            fail("wrong size");
+        auto it = map.find(1);
+        if (it == map.end() || it->second != "ax")
+            fail("wrong find");
+        it->second = "c";
+        const auto &const_map = map;
+        if (const_map.at(1) != "c")
+            fail("can't modificate through iterator");
+        std::size_t count = 0;
+        for (auto cur : const_map) {
+            if (cur.first % 3 == 0)
+                fail("erased element is still iterated");
+            ++count;
+        }
+        if (count != 2000)
+            fail("wrong number of iterated elements");
+        std::cerr << "ok!\n";
+    }
+
+/* check that narrow link indices work and refuse tables they can't address */
+    void check_index_type() {
+        std::cerr << "check index type...\n";
+        HashMap<int, int, std::hash<int>, InterleavedLayout, std::uint16_t> map;
+        for (int i = 0; i < 25000; ++i)
+            map[i] = i;
+        if (map.size() != 25000 || map.at(24999) != 24999)
+            fail("wrong size or at");
+        try {
+            for (int i = 25000; i < 70000; ++i)
+                map[i] = i;
+            fail("table outgrew its index type");
+        }
+        catch (const std::length_error& e) {
+        }
+        std::cerr << "ok!\n";
+    }
+
+/* check the cellar and every chain insertion mode with colliding keys */
+    void check_cellar() {
+        std::cerr << "check cellar...\n";
+        for (auto mode : {InsertionMode::LATE, InsertionMode::EARLY, InsertionMode::VARIED}) {
+            HashMap<int, int, std::function<size_t(int)>> map([](int x) -> size_t { return x % 101; });
+            map.address_factor(0.86);
+            map.insertion_mode(mode);
+            for (int i = 0; i < 2000; ++i)
+                map[i] = i;
+            for (int i = 0; i < 2000; i += 4)
+                map.erase(i);
+            if (map.size() != 1500)
+                fail("wrong size");
+            for (int i = 0; i < 2000; ++i) {
+                auto it = map.find(i);
+                if ((it == map.end()) != (i % 4 == 0))
+                    fail("wrong find");
+                if (it != map.end() && it->second != i)
+                    fail("wrong value");
+            }
+        }
+        std::cerr << "ok!\n";
+    }
+
+/* check the power-of-two and fastrange indexers with an identity hash */
+    template<class Indexer>
+    void check_indexer(bool power_of_two) {
+        HashMap<StrangeInt, int, std::hash<StrangeInt>, InterleavedLayout, std::uint32_t, Indexer> map;
+        map.reserve(3000);
+        if (power_of_two && (map.slot_count() & (map.slot_count() - 1)))
+            fail("slot count isn't a power of two");
+        for (int i = 0; i < 10000; i += 2)
+            map[StrangeInt(i)] = i;
+        for (int i = 0; i < 10000; i += 4)
+            map.erase(StrangeInt(i));
+        if (map.size() != 2500)
+            fail("wrong size");
+        for (int i = 0; i < 10000; ++i) {
+            if ((map.find(StrangeInt(i)) == map.end()) != (i % 4 != 2))
+                fail("wrong find");
+        }
+    }
+
+    void check_indexers() {
+        std::cerr << "check indexers...\n";
+        check_indexer<PowerOfTwoIndexer>(true);
+        check_indexer<FastRangeIndexer>(false);
+        std::cerr << "ok!\n";
+    }
+
+/* check that stored hash codes spare rehashing keys on erase and rehash */
+    void check_stored_hash() {
+        std::cerr << "check stored hash...\n";
+        static std::size_t hash_calls;
+        struct CountingHash {
+            size_t operator()(const std::string& s) const {
+                ++hash_calls;
+                return std::hash<std::string>()(s) % 97;
+            }
+        };
+        HashMap<std::string, int, CountingHash, InterleavedLayout, std::uint32_t, ModuloIndexer, StoredHash<>> map;
+        hash_calls = 0;
+        for (int i = 0; i < 3000; ++i)
+            map.insert(std::make_pair(std::to_string(i), i));
+        if (hash_calls != 3000)
+            fail("keys are rehashed on insert or rehash");
+        map.rehash(8192);
+        for (int i = 0; i < 3000; i += 2)
+            map.erase(std::to_string(i));
+        if (hash_calls != 4500)
+            fail("keys are rehashed on erase or rehash");
+        for (int i = 0; i < 3000; ++i) {
+            if ((map.find(std::to_string(i)) == map.end()) != (i % 2 == 0))
+                fail("wrong find");
+        }
+
+        // narrow codes only filter compares, addresses still spread over the whole table
+        HashMap<int, int, std::hash<int>, InterleavedLayout, std::uint32_t, FastRangeIndexer, StoredHash<std::uint8_t>>
+                narrow;
+        HashMap<int, int, std::hash<int>, SplitLayout, std::uint32_t, PowerOfTwoIndexer, StoredHash<std::uint16_t>>
+                narrow_split;
+        narrow_split.incremental_rehash(true);
+        for (int i = 0; i < 100000; ++i) {
+            narrow[i * 7919] = i;
+            narrow_split[i * 7919] = i;
+        }
+        for (int i = 0; i < 100000; i += 3) {
+            narrow.erase(i * 7919);
+            narrow_split.erase(i * 7919);
+        }
+        if (narrow.chain_length_histogram().size() > 20 || narrow_split.chain_length_histogram().size() > 20)
+            fail("narrow hash codes lengthen chains");
+        for (int i = 0; i < 100000; ++i) {
+            bool erased = i % 3 == 0;
+            if ((narrow.find(i * 7919) == narrow.end()) != erased ||
+                (narrow_split.find(i * 7919) == narrow_split.end()) != erased)
+                fail("wrong find with narrow hash codes");
+        }
+        std::cerr << "ok!\n";
+    }
+
+/* check lookups by std::string_view and const char* with a transparent hash */
+    void check_heterogeneous_lookup() {
+        std::cerr << "check heterogeneous lookup...\n";
+        struct TransparentHash {
+            using is_transparent = void;
+            size_t operator()(std::string_view s) const {
+                return std::hash<std::string_view>()(s);
+            }
+        };
+        HashMap<std::string, int, TransparentHash> map{{"aba", 1}, {"caba", 2}};
+        std::string_view key = "caba";
+        if (map.find(key) == map.end() || map.find(key)->second != 2)
+            fail("wrong find by string_view");
+        const auto &const_map = map;
+        if (const_map.at("aba") != 1 || const_map.find(std::string_view("x")) != const_map.end())
+            fail("wrong const find or at by const char*");
+        map[std::string_view("new")] = 3;
+        if (map.size() != 3 || map.at(std::string("new")) != 3)
+            fail("wrong [ ] by string_view");
+        map.erase("aba");
+        if (map.size() != 2 || map.find("aba") != map.end())
+            fail("wrong erase by const char*");
+        std::cerr << "ok!\n";
+    }
+
+/* check that emplace, try_emplace and insert_or_assign don't copy values */
+    void check_emplace() {
+        std::cerr << "check emplace...\n";
+        static int copies;
+        struct Heavy {
+            int payload = 0;
+            Heavy() = default;
+            Heavy(int payload): payload(payload) {}
+            Heavy(const Heavy& rs): payload(rs.payload) {
+                copies += payload != 0;
+            }
+            Heavy(Heavy&&) = default;
+            Heavy& operator =(const Heavy& rs) {
+                copies += rs.payload != 0;
+                payload = rs.payload;
+                return *this;
+            }
+            Heavy& operator =(Heavy&&) = default;
+        };
+        copies = 0;
+        HashMap<int, Heavy> map;
+        auto result = map.try_emplace(1, 10);
+        if (!result.second || result.first->second.payload != 10)
+            fail("wrong try_emplace");
+        result = map.try_emplace(1, 20);
+        if (result.second || result.first->second.payload != 10)
+            fail("try_emplace overwrites");
+        result = map.emplace(2, Heavy(30));
+        if (!result.second || map.at(2).payload != 30)
+            fail("wrong emplace");
+        result = map.insert_or_assign(2, Heavy(40));
+        if (result.second || map.at(2).payload != 40)
+            fail("wrong insert_or_assign");
+        result = map.insert(std::make_pair(3, Heavy(50)));
+        if (!result.second || result.first->first != 3)
+            fail("wrong insert");
+        map[4].payload = 60;
+        for (int i = 5; i < 3000; ++i)
+            map.try_emplace(i, i);
+        if (map.size() != 2999 || map.at(4).payload != 60 || map.at(2999).payload != 2999)
+            fail("wrong size or at");
+        if (copies != 0)
+            fail("values are copied");
+        std::cerr << "ok!\n";
+    }
+
+/* check move operations, swap and clear */
+    void check_move() {
+        std::cerr << "check move, swap and clear...\n";
+        HashMap<int, int> first{{1, 1}, {2, 2}};
+        HashMap<int, int> second(std::move(first));
+        if (second.size() != 2 || second.at(2) != 2)
+            fail("wrong move constructor");
+        if (!first.empty() || first.find(1) != first.end() || first.begin() != first.end())
+            fail("moved-from map isn't empty");
+        first[3] = 3;
+        first.erase(5);
+        if (first.size() != 1 || first.at(3) != 3)
+            fail("moved-from map is unusable");
+        first = std::move(second);
+        if (first.size() != 2 || first.find(3) != first.end())
+            fail("wrong move assignment");
+        swap(first, second);
+        if (!first.empty() || second.size() != 2)
+            fail("wrong swap");
+
+        auto modulo_hash = [](int x) -> size_t { return x % 7; };
+        HashMap<int, int, std::function<size_t(int)>> map(modulo_hash);
+        map.reserve(5000);
+        for (int i = 0; i < 3000; ++i)
+            map[i] = i;
+        std::size_t slot_count = map.slot_count();
+        map.clear();
+        if (!map.empty() || map.begin() != map.end() || map.slot_count() != slot_count)
+            fail("clear doesn't keep capacity");
+        if (map.hash_function()(10) != 3)
+            fail("clear drops the hash function");
+        for (int i = 0; i < 1000; ++i)
+            map[i] = -i;
+        if (map.size() != 1000 || map.at(999) != -999)
+            fail("wrong insert after clear");
+        std::cerr << "ok!\n";
+    }
+
+    struct NoDefault {
+        explicit NoDefault(int x) : x(x) {}
+
+        int x;
+    };
+
+    struct CountedMoves {
+        static int moves;
+        int x;
+
+        explicit CountedMoves(int x) : x(x) {}
+
+        CountedMoves(CountedMoves &&other) noexcept : x(other.x) {
+            ++moves;
+        }
+    };
+
+    int CountedMoves::moves = 0;
+
+    template<class Layout>
+    void check_slot_storage() {
+        {
+            HashMap<int, CountedMoves, std::hash<int>, Layout> map(1000);
+            CountedMoves::moves = 0;
+            for (int i = 0; i < 500; ++i)
+                map.try_emplace(i, i);
+            if (CountedMoves::moves != 0 || map.size() != 500 || map.find(7)->second.x != 7)
+                fail("try_emplace doesn't construct in place");
+        }
+        StrangeInt::init();
+        {
+            HashMap<StrangeInt, NoDefault, std::hash<StrangeInt>, Layout> map;
+            if (StrangeInt::counter)
+                fail("empty slots construct keys");
+            map.incremental_rehash(true);
+            for (int i = 0; i < 5000; ++i)
+                map.try_emplace(StrangeInt(i), i);
+            for (int i = 0; i < 5000; i += 2)
+                map.erase(StrangeInt(i));
+            if (StrangeInt::counter != 2500)
+                fail("wrong number of live keys");
+            HashMap<StrangeInt, NoDefault, std::hash<StrangeInt>, Layout> copy(map);
+            copy.shrink_to_fit();
+            if (StrangeInt::counter != 5000)
+                fail("wrong number of live keys after copy");
+            for (int i = 1; i < 5000; i += 2) {
+                if (copy.find(StrangeInt(i))->second.x != i)
+                    fail("wrong value after copy");
+            }
+            map.clear();
+            if (StrangeInt::counter != 2500)
+                fail("clear doesn't destroy elements");
+        }
+        if (StrangeInt::counter)
+            fail("wrong destructor");
+    }
+
+/* check that empty slots hold no objects and value types need no default constructor */
+    void check_slot_storage() {
+        std::cerr << "check slot storage...\n";
+        check_slot_storage<InterleavedLayout>();
+        check_slot_storage<SplitLayout>();
+        std::cerr << "ok!\n";
+    }
+
+    class CountingResource : public std::pmr::memory_resource {
+    public:
+        std::size_t allocated = 0;
+        std::size_t live = 0;
+
+    private:
+        void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+            allocated += bytes;
+            live += bytes;
+            return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+        }
+
+        void do_deallocate(void *pointer, std::size_t bytes, std::size_t alignment) override {
+            live -= bytes;
+            std::pmr::new_delete_resource()->deallocate(pointer, bytes, alignment);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+            return this == &other;
+        }
+    };
+
+/* check that slots and elements come from the allocator of the map */
+    void check_allocator() {
+        std::cerr << "check allocator...\n";
+        CountingResource resource;
+        {
+            pmr::HashMap<int, std::pmr::string, std::hash<int>, SplitLayout> map(&resource);
+            map.incremental_rehash(true);
+            for (int i = 0; i < 3000; ++i)
+                map[i] = std::string(40, 'a' + i % 26);
+            if (resource.allocated == 0 || map.get_allocator().resource() != &resource)
+                fail("slots don't come from the memory resource");
+            if (map.at(7).get_allocator().resource() != &resource)
+                fail("values don't use the memory resource");
+
+            CountingResource other_resource;
+            pmr::HashMap<int, std::pmr::string, std::hash<int>, SplitLayout> other(&other_resource);
+            other = map;
+            if (other.get_allocator().resource() != &other_resource || other.size() != 3000 || other.at(42) != map.at(42))
+                fail("wrong copy assignment with another memory resource");
+            other = std::move(map);
+            if (other.get_allocator().resource() != &other_resource || other.size() != 3000 || !map.empty())
+                fail("wrong move assignment with another memory resource");
+            other.clear();
+            other.shrink_to_fit();
+        }
+        if (resource.live != 0)
+            fail("memory resource leaks");
+
+        std::pmr::monotonic_buffer_resource arena;
+        {
+            pmr::HashMap<int, int> map(100, std::hash<int>(), &arena);
+            for (int i = 0; i < 1000; ++i)
+                map[i] = i;
+            if (map.size() != 1000 || map.at(999) != 999)
+                fail("wrong map in a monotonic arena");
+        }
+
+        HashMap<int, int, std::hash<int>, InterleavedLayout, std::uint32_t, ModuloIndexer, NoStoredHash,
+                HugePageAllocator<std::pair<const int, int>, 4096>> map;
+        map.reserve(100000);
+        for (int i = 0; i < 100000; ++i)
+            map[i] = -i;
+        HashMap<int, int, std::hash<int>, InterleavedLayout, std::uint32_t, ModuloIndexer, NoStoredHash,
+                HugePageAllocator<std::pair<const int, int>, 4096>> copy(map);
+        for (int i = 0; i < 100000; i += 7) {
+            if (copy.at(i) != -i)
+                fail("wrong map on huge pages");
+        }
+        std::cerr << "ok!\n";
+    }
+
+/* check the bitmap searches against a scan of single bits */
+    void check_slot_bitmap() {
+        std::cerr << "check slot bitmap...\n";
+        std::uint64_t seed = 1;
+        for (std::size_t size : {1, 63, 64, 65, 300, 1000}) {
+            for (int density = 0; density <= 8; ++density) {
+                std::vector<std::uint64_t> words(bitmap_words(size));
+                for (std::size_t i = 0; i < size; ++i) {
+                    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+                    if (static_cast<int>(seed >> 61) < density)
+                        set_bit(words.data(), i);
+                }
+                for (std::size_t i = 0; i < size; ++i) {
+                    std::size_t next = i;
+                    while (next < size && !test_bit(words.data(), next))
+                        ++next;
+                    if (find_next_set(words.data(), size, i) != next)
+                        fail("wrong next set bit");
+                    std::size_t prev = i;
+                    while (prev != size && test_bit(words.data(), prev))
+                        prev = prev == 0 ? size : prev - 1;
+                    if (find_prev_clear(words.data(), size, i) != prev)
+                        fail("wrong previous clear bit");
+                }
+            }
+        }
+        std::cerr << "ok!\n";
+    }
+
+/* check that erased slots are reused for collisions without a rehash */
+    void check_free_slots() {
+        std::cerr << "check free slots...\n";
+        auto modulo_hash = [](int x) -> size_t { return x % 64; };
+        HashMap<int, int, decltype(modulo_hash)> map(modulo_hash);
+        map.auto_shrink(false);
+        for (int i = 0; i < 700; ++i)
+            map[i] = i;
+        std::size_t slot_count = map.slot_count();
+        for (int i = 0; i < 20000; ++i) {
+            map.erase(i);
+            map[i + 700] = i;
+        }
+        if (map.size() != 700 || map.slot_count() != slot_count)
+            fail("churn changed the table");
+        for (int i = 20000; i < 20700; ++i) {
+            if (map.at(i) != i - 700)
+                fail("wrong value after churn");
+        }
+        std::cerr << "ok!\n";
+    }
+
+/* check that lock-free readers always see keys that stay in the map while writers insert, erase and grow */
+    void check_concurrent() {
+        std::cerr << "check concurrent map...\n";
+        ConcurrentHashMap<int, long long> map(16);
+        for (int i = 0; i < 1000; ++i)
+            map.insert(i, i * 3LL);
+        if (map.insert(5, 0) || !map.insert_or_assign(1000, 3000) || map.insert_or_assign(1000, 3000))
+            fail("wrong insert result");
+        if (map.size() != 1001 || map.at(999) != 2997 || map.contains(1001))
+            fail("wrong lookup");
+
+        std::atomic<bool> done{false};
+        std::atomic<int> errors{0};
+        std::vector<std::thread> readers;
+        for (int t = 0; t < 4; ++t) {
+            readers.emplace_back([&map, &done, &errors, t] {
+                long long value;
+                for (int i = t; !done.load(); i = (i + 7) % 1000) {
+                    if (!map.find(i, value) || value != i * 3LL)
+                        errors.fetch_add(1);
+                }
+            });
+        }
+        for (int round = 0; round < 20; ++round) {
+            for (int i = 1000; i < 6000; ++i)
+                map.insert(i, -i);
+            for (int i = 1000; i < 6000; ++i)
+                map.erase(i);
+        }
+        done.store(true);
+        for (std::thread &reader : readers)
+            reader.join();
+        if (errors.load() != 0)
+            fail("a reader missed a key");
+
+        long long sum = 0;
+        map.for_each([&sum](int, long long value) { sum += value; });
+        if (map.size() != 1000 || sum != 3LL * 999 * 1000 / 2)
+            fail("wrong elements after concurrent writes");
+        std::cerr << "ok!\n";
+    }
+
+/* check that shards split the keys, count them together and keep concurrent updates of different keys apart */
+    void check_sharded() {
+        std::cerr << "check sharded map...\n";
+        ShardedHashMap<int, int, std::hash<int>, 8> map;
+        map.reserve(4000);
+        std::vector<std::thread> writers;
+        for (int t = 0; t < 4; ++t) {
+            writers.emplace_back([&map] {
+                for (int round = 0; round < 10; ++round) {
+                    for (int i = 0; i < 1000; ++i)
+                        map.update(i, [](int &value) { ++value; });
+                }
+            });
+        }
+        for (std::thread &writer : writers)
+            writer.join();
+        if (map.size() != 1000 || map.empty())
+            fail("wrong size after concurrent updates");
+        long long sum = 0;
+        map.for_each([&sum](int, int value) { sum += value; });
+        if (sum != 40000)
+            fail("lost an update");
+
+        std::size_t shards_size = 0;
+        bool all_used = true;
+        map.for_each_shard([&shards_size, &all_used](const ShardedHashMap<int, int, std::hash<int>, 8>::Shard &shard) {
+            shards_size += shard.size();
+            all_used = all_used && !shard.empty();
+        });
+        if (shards_size != 1000 || !all_used)
+            fail("keys don't spread over the shards");
+
+        int value;
+        if (map.insert({5, 0}) || !map.insert({1000, 7}) || !map.find(1000, value) || value != 7)
+            fail("wrong insert");
+        if (map.insert_or_assign(1000, 8) || !map.find(1000, value) || value != 8 || map.find(1001, value))
+            fail("wrong insert_or_assign");
+        if (!map.erase(1000) || map.erase(1000) || map.contains(1000) || !map.contains(999))
+            fail("wrong erase");
+        map.clear();
+        if (!map.empty() || map.contains(0))
+            fail("wrong clear");
+        std::cerr << "ok!\n";
+    }
+
+    // every hash code is shared by eight keys
+    struct CollidingHash {
+        std::size_t operator()(int x) const {
+            return static_cast<std::size_t>(x / 8);
+        }
+    };
+
+    template<class Map>
+    void check_batch() {
+        Map map;
+        std::vector<std::pair<int, int>> values;
+        for (int i = 0; i < 3000; ++i)
+            values.emplace_back(i, -i);
+        values.emplace_back(5, 0);
+        if (map.insert_batch(values.begin(), values.end()) != 3000 || map.size() != 3000 || map.at(5) != -5)
+            fail("wrong insert_batch");
+        if (map.insert_batch(values.begin(), values.begin() + 100) != 0 || map.size() != 3000)
+            fail("insert_batch inserts present keys");
+
+        // leave a migration in progress, so some keys are still in the old table
+        map.incremental_rehash(true);
+        int size = 3000;
+        for (; !map.rehashing(); ++size)
+            map.insert({size, -size});
+        for (int i = 0; i < 10; ++i, ++size)
+            map.insert({size, -size});
+        if (!map.rehashing())
+            fail("no migration in progress");
+
+        std::vector<int> keys;
+        for (int i = -50; i < 8000; i += 3)
+            keys.push_back(i);
+        const Map &const_map = map;
+        std::vector<typename Map::const_iterator> found(keys.size());
+        std::vector<bool> contained(keys.size());
+        const_map.find_batch(keys.begin(), keys.end(), found.begin());
+        const_map.contains_batch(keys.begin(), keys.end(), contained.begin());
+        for (std::size_t k = 0; k < keys.size(); ++k) {
+            bool present = keys[k] >= 0 && keys[k] < size;
+            if (present != (found[k] != const_map.end()) || present != contained[k])
+                fail("wrong batched lookup");
+            if (present && (found[k]->first != keys[k] || found[k]->second != -keys[k]))
+                fail("wrong element from batched lookup");
+        }
+
+        std::vector<typename Map::iterator> iterators;
+        map.find_batch(keys.begin(), keys.end(), std::back_inserter(iterators));
+        for (std::size_t k = 0; k < keys.size(); ++k) {
+            if (iterators[k] != map.end() && (iterators[k]->first != keys[k] || (iterators[k]->second *= 2) != -2 * keys[k]))
+                fail("wrong element from mutable batched lookup");
+        }
+        if (map.at(7) != -14)
+            fail("batched lookup doesn't give mutable iterators");
+    }
+
+/* check that batched lookups and inserts agree with one at a time ones, also during an incremental rehash */
+    void check_batch() {
+        std::cerr << "check batched operations...\n";
+        check_batch<HashMap<int, int>>();
+        check_batch<HashMap<int, int, std::hash<int>, SplitLayout>>();
+        check_batch<HashMap<int, int, CollidingHash, InterleavedLayout, std::uint32_t, ModuloIndexer, StoredHash<>>>();
+        check_batch<HashMap<int, int, CollidingHash, SplitLayout, std::uint32_t, PowerOfTwoIndexer, StoredHash<>>>();
+        std::cerr << "ok!\n";
+    }
+
+    // yields the pairs (i, i % modulo) for i below size, and can be read only once
+    struct PairInput {
+        using iterator_category = std::input_iterator_tag;
+        using value_type = std::pair<int, int>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const std::pair<int, int> *;
+        using reference = std::pair<int, int>;
+
+        int i;
+        int modulo;
+
+        std::pair<int, int> operator*() const {
+            return std::make_pair(i, i % modulo);
+        }
+
+        PairInput &operator++() {
+            ++i;
+            return *this;
+        }
+
+        bool operator==(const PairInput &other) const {
+            return i == other.i;
+        }
+
+        bool operator!=(const PairInput &other) const {
+            return i != other.i;
+        }
+    };
+
+    struct ThrowingHash {
+        std::size_t operator()(int x) const {
+            if (x == 77777)
+                throw std::runtime_error("hash");
+            return std::hash<int>()(x);
+        }
+    };
+
+    // copying may throw, so swapping maps that hold one may too
+    struct CopyThrowingHash : std::hash<int> {
+        CopyThrowingHash() = default;
+
+        CopyThrowingHash(const CopyThrowingHash &) noexcept(false) {}
+
+        CopyThrowingHash &operator=(const CopyThrowingHash &) noexcept(false) {
+            return *this;
+        }
+    };
+
+    static_assert(std::is_nothrow_swappable<HashMap<int, int>>::value &&
+                  !std::is_nothrow_swappable<HashMap<int, int, CopyThrowingHash>>::value,
+                  "swap is noexcept exactly when swapping the hash functions is");
+
+    template<class Map>
+    void check_build(InsertionMode mode) {
+        std::vector<std::pair<int, int>> values;
+        std::map<int, int> expected;
+        std::uint64_t random = 1;
+        for (int i = 0; i < 100000; ++i) {
+            random = random * 6364136223846793005ULL + 1442695040888963407ULL;
+            int key = static_cast<int>(random >> 40) % 60000;
+            values.emplace_back(key, i);
+            expected.emplace(key, i);
+        }
+
+        Map serial;
+        serial.address_factor(0.86);
+        serial.insertion_mode(mode);
+        serial.build(values.begin(), values.end());
+        Map parallel;
+        parallel.address_factor(0.86);
+        parallel.insertion_mode(mode);
+        parallel.parallel_build(values.begin(), values.end(), 4);
+        Map uneven;
+        uneven.address_factor(0.86);
+        uneven.insertion_mode(mode);
+        uneven.parallel_build(values.begin(), values.end(), 3);
+        for (const Map *map : {&serial, &parallel, &uneven}) {
+            if (map->size() != expected.size())
+                fail("wrong size after build");
+            for (const auto &element : expected) {
+                if (map->at(element.first) != element.second)
+                    fail("build doesn't keep the first of equal keys");
+            }
+        }
+        if (serial.slot_count() != parallel.slot_count())
+            fail("build isn't sized once");
+        serial.insert({-1, 0});
+        serial.erase(values[0].first);
+        if (serial.size() != expected.size() || serial.find(values[0].first) != serial.end())
+            fail("wrong map after build");
+    }
+
+/* check that bulk builds from all kinds of ranges agree with inserting one at a time */
+    void check_build() {
+        std::cerr << "check build...\n";
+        check_build<HashMap<int, int>>(InsertionMode::LATE);
+        check_build<HashMap<int, int, std::hash<int>, SplitLayout, std::uint32_t, FastRangeIndexer, StoredHash<>>>(
+                InsertionMode::EARLY);
+        check_build<HashMap<int, int, CollidingHash, InterleavedLayout, std::uint32_t, PowerOfTwoIndexer>>(
+                InsertionMode::VARIED);
+
+        // a single pass range, counted in a buffer or sized by a hint that may be wrong
+        HashMap<int, int> counted(PairInput{0, 7}, PairInput{5000, 7});
+        for (std::size_t size_hint : {0, 10, 5000, 100000}) {
+            HashMap<int, int> map;
+            map.insert({-5, 5});
+            map.build(PairInput{0, 7}, PairInput{5000, 7}, size_hint);
+            if (map.size() != 5000 || map.find(-5) != map.end() || map.at(4999) != 4999 % 7)
+                fail("wrong build from a single pass range");
+        }
+        if (counted.size() != 5000 || counted.at(1234) != 1234 % 7)
+            fail("wrong range constructor");
+        HashMap<int, int> copy(counted.begin(), counted.end());
+        if (copy.size() != 5000 || copy.at(4321) != 4321 % 7)
+            fail("wrong range constructor from map iterators");
+
+        std::vector<std::pair<int, int>> values;
+        for (int i = 0; i < 100000; ++i)
+            values.emplace_back(i, i);
+        HashMap<int, int, ThrowingHash> map;
+        map.insert({1, 1});
+        try {
+            map.parallel_build(values.begin(), values.end(), 4);
+            fail("no exception from parallel_build");
+        } catch (const std::runtime_error &) {
+        }
+        if (!map.empty() || map.find(1) != map.end())
+            fail("parallel_build leaves elements after an exception");
+        map.parallel_build(values.begin(), values.begin() + 70000, 4);
+        if (map.size() != 70000)
+            fail("wrong parallel_build after an exception");
+        std::cerr << "ok!\n";
+    }
+
+    struct SeededHash {
+        std::size_t seed;
+
+        std::size_t operator()(int x) const {
+            return std::hash<int>()(x) ^ seed;
+        }
+    };
+
+    template<class Layout, class Indexer, class HashStorage>
+    void check_snapshot() {
+        using Map = HashMap<int, long long, SeededHash, Layout, std::uint32_t, Indexer, HashStorage>;
+        const char *path = "test_snapshot.bin";
+        Map map(SeededHash{12345});
+        map.address_factor(0.86);
+        map.incremental_rehash(true);
+        for (int i = 0; i < 20000; ++i)
+            map.insert({i * 7, i * 3LL});
+        for (int i = 0; i < 20000; i += 3)
+            map.erase(i * 7);
+        map.save(path);
+
+        {
+            auto mapped = Map::map_readonly(path, SeededHash{12345});
+            if (mapped.size() != map.size() || mapped.empty())
+                fail("wrong size of mapped snapshot");
+            for (int i = 0; i < 20000; ++i) {
+                auto it = mapped.find(i * 7);
+                if ((it != mapped.end()) != (i % 3 != 0) || (it != mapped.end() && it->second != i * 3LL))
+                    fail("wrong lookup in mapped snapshot");
+            }
+            if (mapped.find(1) != mapped.end() || mapped.at(14) != 6)
+                fail("wrong lookup in mapped snapshot");
+            std::size_t count = 0;
+            long long sum = 0;
+            for (const auto &element : mapped) {
+                ++count;
+                sum += element.second;
+            }
+            long long expected_sum = 0;
+            for (const auto &element : map)
+                expected_sum += element.second;
+            if (count != map.size() || sum != expected_sum)
+                fail("wrong iteration over mapped snapshot");
+            try {
+                mapped.at(1);
+                fail("no exception from at");
+            } catch (const std::out_of_range &) {
+            }
+        }
+
+        bool thrown = false;
+        try {
+            Map::map_readonly(path, SeededHash{54321});
+        } catch (const std::runtime_error &) {
+            thrown = true;
+        }
+        if (!thrown)
+            fail("snapshot opens with a different hash seed");
+        thrown = false;
+        try {
+            MappedHashMap<int, int, SeededHash, Layout, std::uint32_t, Indexer, HashStorage>(path, SeededHash{12345});
+        } catch (const std::runtime_error &) {
+            thrown = true;
+        }
+        if (!thrown)
+            fail("snapshot opens with a different value type");
+        std::remove(path);
+    }
+
+/* check that saved maps are served from their snapshot files and that mismatching files are refused */
+    void check_snapshot() {
+        std::cerr << "check snapshot...\n";
+        check_snapshot<InterleavedLayout, ModuloIndexer, NoStoredHash>();
+        check_snapshot<InterleavedLayout, PowerOfTwoIndexer, StoredHash<std::uint32_t>>();
+        check_snapshot<SplitLayout, FastRangeIndexer, NoStoredHash>();
+        check_snapshot<SplitLayout, ModuloIndexer, StoredHash<>>();
+
+        const char *path = "test_snapshot.bin";
+        HashMap<int, int> empty;
+        HashMap<int, int> moved(std::move(empty));
+        empty.save(path);
+        if (!HashMap<int, int>::map_readonly(path).empty())
+            fail("wrong snapshot of a moved-from map");
+        moved.save(path);
+        auto mapped = HashMap<int, int>::map_readonly(path);
+        if (mapped.size() != 0 || mapped.begin() != mapped.end() || mapped.find(0) != mapped.end())
+            fail("wrong snapshot of an empty map");
+
+        bool thrown = false;
+        try {
+            HashMap<int, int, std::hash<int>, SplitLayout>::map_readonly(path);
+        } catch (const std::runtime_error &) {
+            thrown = true;
+        }
+        if (!thrown)
+            fail("snapshot opens with a different layout");
+
+        std::FILE *file = std::fopen(path, "wb");
+        std::fputs("CHMSNAP", file);
+        std::fclose(file);
+        thrown = false;
+        try {
+            HashMap<int, int>::map_readonly(path);
+        } catch (const std::runtime_error &) {
+            thrown = true;
+        }
+        if (!thrown)
+            fail("truncated snapshot opens");
+
+        // damaged links make lookups throw instead of running off the table or around a cycle
+        using Colliding = HashMap<int, int, CollidingHash, SplitLayout>;
+        Colliding colliding;
+        for (int i = 0; i < 8; ++i)
+            colliding.insert({i, i});
+        for (std::uint32_t link : {std::uint32_t(0), std::uint32_t(1000)}) {
+            colliding.save(path);
+            std::string bytes;
+            {
+                std::ifstream in(path, std::ios::binary);
+                bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            }
+            SnapshotHeader header;
+            std::memcpy(&header, bytes.data(), sizeof(header));
+            for (std::size_t i = 0; i < header.slot_count; ++i)
+                std::memcpy(&bytes[header.offsets[0] + i * sizeof(link)], &link, sizeof(link));
+            {
+                std::ofstream out(path, std::ios::binary | std::ios::trunc);
+                out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+            }
+            auto damaged = Colliding::map_readonly(path);
+            thrown = false;
+            try {
+                damaged.find(7);
+            } catch (const std::runtime_error &) {
+                thrown = true;
+            }
+            if (!thrown)
+                fail("damaged links are followed");
+        }
+
+        // bits past the last slot would let iteration run off the slots
+        HashMap<int, int> small{{1, 1}, {2, 2}, {3, 3}};
+        small.save(path);
+        std::string bytes;
+        {
+            std::ifstream in(path, std::ios::binary);
+            bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+        SnapshotHeader header;
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        if (header.slot_count % 64 == 0)
+            fail("snapshot fills its last bitmap word");
+        bytes[header.offsets[0] + 7] |= static_cast<char>(0x80);
+        {
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        }
+        thrown = false;
+        try {
+            HashMap<int, int>::map_readonly(path);
+        } catch (const std::runtime_error &) {
+            thrown = true;
+        }
+        if (!thrown)
+            fail("snapshot with bits past its slots opens");
+        std::remove(path);
+        std::cerr << "ok!\n";
+    }
+
+/* check that maps stream out and back in with all options and that damaged streams are refused */
+    void check_serialization() {
+        std::cerr << "check serialization...\n";
+        HashMap<std::string, std::vector<int>> map;
+        for (int i = 0; i < 3000; ++i)
+            map.emplace("key number " + std::to_string(i), std::vector<int>(i % 5, -i));
+        map.emplace(std::string("with\0zero", 9), std::vector<int>{1 << 30});
+
+        for (bool compress : {false, true}) {
+            for (bool checksums : {false, true}) {
+                SerializeOptions options;
+                options.chunk_bytes = compress ? 1 << 12 : 100;
+                options.compress = compress;
+                options.checksums = checksums;
+                std::stringstream stream;
+                map.serialize(stream, options);
+                if (compress && stream.str().size() * 2 > 3000 * 30)
+                    fail("compression doesn't shrink the stream");
+
+                HashMap<std::string, std::vector<int>, std::hash<std::string>, SplitLayout> copy;
+                copy.insert({"stale", {}});
+                copy.deserialize(stream);
+                if (copy.size() != map.size() || copy.find("stale") != copy.end())
+                    fail("wrong size after deserialize");
+                for (const auto &element : map) {
+                    if (copy.at(element.first) != element.second)
+                        fail("wrong element after deserialize");
+                }
+            }
+        }
+
+        // floating point values are written little-endian, whatever the host byte order
+        std::string encoded;
+        Codec<double>::encode(1.0, encoded);
+        Codec<float>::encode(-2.0f, encoded);
+        if (encoded != std::string("\0\0\0\0\0\0\xF0\x3F\0\0\0\xC0", 12))
+            fail("floating point isn't encoded little-endian");
+        ByteReader encoded_reader(encoded.data(), encoded.size());
+        if (Codec<double>::decode(encoded_reader) != 1.0 || Codec<float>::decode(encoded_reader) != -2.0f)
+            fail("wrong floating point decode");
+
+        std::stringstream stream;
+        map.serialize(stream);
+        std::string bytes = stream.str();
+        std::string damaged = bytes;
+        damaged[damaged.size() / 2] ^= 1;
+        std::string truncated = bytes.substr(0, bytes.size() - 10);
+        for (const std::string &input : {damaged, truncated, std::string("CHMSTRM")}) {
+            std::stringstream in(input);
+            HashMap<std::string, std::vector<int>> copy;
+            bool thrown = false;
+            try {
+                copy.deserialize(in);
+            } catch (const std::runtime_error &) {
+                thrown = true;
+            }
+            if (!thrown || !copy.empty())
+                fail("damaged stream deserializes");
+        }
+
+        // a damaged element count sizes no table for elements that aren't there
+        std::string inflated = bytes;
+        for (int k = 0; k < 8; ++k)
+            inflated[16 + k] = static_cast<char>((std::uint64_t(1) << 26) >> (8 * k));
+        std::stringstream inflated_stream(inflated);
+        HashMap<std::string, std::vector<int>> inflated_copy;
+        bool inflated_thrown = false;
+        try {
+            inflated_copy.deserialize(inflated_stream);
+        } catch (const std::runtime_error &) {
+            inflated_thrown = true;
+        }
+        if (!inflated_thrown || !inflated_copy.empty() || inflated_copy.slot_count() > 2 * bytes.size())
+            fail("damaged element count sizes the table");
+        // an honest stream still gets sized up front
+        std::stringstream honest(bytes);
+        HashMap<std::string, std::vector<int>> honest_copy;
+        honest_copy.deserialize(honest);
+        if (honest_copy.size() != map.size() || honest_copy.slot_count() > 2 * map.size())
+            fail("wrong deserialize of an honest stream");
+
+        HashMap<int, double> empty;
+        std::stringstream empty_stream;
+        empty.serialize(empty_stream);
+        HashMap<int, double> empty_copy{{1, 1.5}};
+        empty_copy.deserialize(empty_stream);
+        if (!empty_copy.empty())
+            fail("wrong deserialize of an empty map");
+
+        std::string text;
+        for (int i = 0; i < 20000; ++i)
+            text += static_cast<char>(i % 7 == 0 ? i * 31 : 'a' + i % 3);
+        for (std::size_t size : {0, 1, 5, 300, 20000}) {
+            std::string part = text.substr(0, size);
+            if (lz_decompress(lz_compress(part).data(), lz_compress(part).size(), size) != part)
+                fail("wrong compression round trip");
+        }
+        std::cerr << "ok!\n";
+    }
+
+/* check that counting stats record lookups, inserts, rehashes and chain lengths */
+    void check_stats() {
+        std::cerr << "check stats...\n";
+        using CountingMap = HashMap<int, int, CollidingHash, InterleavedLayout, std::uint32_t, ModuloIndexer,
+                NoStoredHash, std::allocator<std::pair<const int, int>>, CountingStats>;
+        CountingMap map(64);
+        for (int i = 0; i < 80; ++i)
+            map.emplace(i, i);
+        const CountingStats &stats = map.stats();
+        if (stats.inserts != 80 || stats.collision_inserts == 0 || stats.rehashes == 0)
+            fail("wrong insert stats");
+        if (stats.insert_probes < stats.inserts || stats.free_slot_scans == 0)
+            fail("wrong probe stats");
+
+        map.find(7);
+        map.find(1000);
+        if (stats.finds != 2 || stats.find_probes < 2 || stats.max_find_probes > 8)
+            fail("wrong find stats");
+
+        // batched lookups count the same probes as looking up the keys one at a time
+        std::vector<int> keys{7, 1000, 3, 79, -5, 7};
+        map.reset_stats();
+        for (int key : keys)
+            map.find(key);
+        CountingStats single = map.stats();
+        map.reset_stats();
+        std::vector<bool> contained(keys.size());
+        map.contains_batch(keys.begin(), keys.end(), contained.begin());
+        if (stats.finds != single.finds || stats.find_probes != single.find_probes ||
+            stats.max_find_probes != single.max_find_probes)
+            fail("wrong batched find stats");
+
+        std::vector<std::size_t> histogram = map.chain_length_histogram();
+        std::size_t elements = 0;
+        for (std::size_t k = 0; k < histogram.size(); ++k)
+            elements += k * histogram[k];
+        if (elements != map.size() || histogram.size() != 9 || histogram[8] != 10)
+            fail("wrong chain length histogram");
+
+        map.reset_stats();
+        if (map.stats().inserts != 0 || map.stats().rehash_time.count() != 0)
+            fail("stats not reset");
+
+        HashMap<int, int> plain;
+        plain.emplace(1, 1);
+        if (plain.chain_length_histogram() != std::vector<std::size_t>{0, 1} || NoStats::ENABLED)
+            fail("wrong stats without counting");
+        std::cerr << "ok!\n";
+    }
+
+/* check that maps allocate lazily and small maps keep elements inline until they spill */
+    void check_small_map() {
+        std::cerr << "check small map...\n";
+        HashMap<int, int> lazy;
+        if (lazy.slot_count() != 0)
+            fail("default constructor allocates slots");
+        lazy[1] = 1;
+        if (lazy.slot_count() == 0 || lazy.slot_count() > 16 || lazy.at(1) != 1)
+            fail("wrong first allocation");
+
+        SmallHashMap<std::string, std::vector<int>, 4> map;
+        std::map<std::string, std::vector<int>> expected;
+        for (int i = 0; i < 4; ++i) {
+            map[std::to_string(i)].push_back(i);
+            expected[std::to_string(i)].push_back(i);
+        }
+        map.erase("2");
+        expected.erase("2");
+        if (!map.is_inline() || map.size() != 3 || map.find("2") != map.end() || map.at("3") != std::vector<int>{3})
+            fail("wrong inline map");
+
+        SmallHashMap<std::string, std::vector<int>, 4> copy(map);
+        map["4"].push_back(4);
+        expected["4"].push_back(4);
+        // the argument refers to an inline element that moves while the map spills
+        map.try_emplace("self", map.at("1"));
+        expected["self"] = {1};
+        for (int i = 10; i < 30; ++i) {
+            map.insert_or_assign(std::to_string(i), std::vector<int>(2, i));
+            expected[std::to_string(i)] = std::vector<int>(2, i);
+        }
+        if (map.is_inline() || map.size() != expected.size())
+            fail("wrong size after spill");
+        std::size_t visited = 0;
+        for (const auto &element : map) {
+            if (expected.at(element.first) != element.second)
+                fail("wrong element after spill");
+            ++visited;
+        }
+        if (visited != expected.size() || copy.size() != 3 || !copy.is_inline())
+            fail("wrong iteration after spill");
+
+        SmallHashMap<std::string, std::vector<int>, 4> moved(std::move(map));
+        if (moved.size() != expected.size() || !map.empty() || !map.is_inline())
+            fail("wrong move of a spilled map");
+        map = std::move(copy);
+        if (map.size() != 3 || map.at("0") != std::vector<int>{0} || !copy.empty())
+            fail("wrong move of an inline map");
+        moved.clear();
+        if (!moved.is_inline() || !moved.empty() || moved.begin() != moved.end())
+            fail("clear doesn't return to inline storage");
+
+        SmallHashMap<int, int, 2> reserved{{1, 1}, {2, 2}};
+        reserved.reserve(100);
+        if (reserved.is_inline() || reserved.at(2) != 2)
+            fail("reserve doesn't spill");
+        std::cerr << "ok!\n";
+    }
+
+    enum class Opcode {
+        ADD, SUB, MUL, DIV, JMP
+    };
+
+    constexpr auto opcodes = make_static_hashmap<std::string_view, Opcode>(
+            {{"add", Opcode::ADD}, {"sub", Opcode::SUB}, {"mul", Opcode::MUL}, {"div", Opcode::DIV},
+             {"jmp", Opcode::JMP}, {"addi", Opcode::ADD}, {"subi", Opcode::SUB}, {"muli", Opcode::MUL}});
+    static_assert(opcodes.at("muli") == Opcode::MUL && opcodes.find("nop") == opcodes.end(),
+                  "static map doesn't work in constant expressions");
+
+/* check that static maps answer lookups at compile time and at run time and refuse duplicate keys */
+    void check_static_map() {
+        std::cerr << "check static map...\n";
+        std::size_t visited = 0;
+        for (const auto &element : opcodes) {
+            if (opcodes.at(element.first) != element.second)
+                fail("wrong static map iteration");
+            ++visited;
+        }
+        if (visited != opcodes.size() || opcodes.slot_count() != 8 || opcodes.at(std::string("jmp")) != Opcode::JMP)
+            fail("wrong static map");
+        bool thrown = false;
+        try {
+            opcodes.at("nop");
+        } catch (const std::out_of_range &) {
+            thrown = true;
+        }
+        if (!thrown)
+            fail("at doesn't throw on a missing key");
+
+        // with a slot per possible pair of keys some seed almost surely places every key at its hash address
+        constexpr auto squares = make_static_hashmap<int, int, 64>(
+                {{1, 1}, {2, 4}, {3, 9}, {4, 16}, {5, 25}, {6, 36}, {7, 49}, {8, 64}});
+        static_assert(squares.perfect() && squares.at(7) == 49, "wrong perfect static map");
+
+        std::pair<int, int> pairs[] = {{1, 1}, {2, 2}, {1, 3}};
+        thrown = false;
+        try {
+            StaticHashMap<int, int, 3> duplicates(pairs);
+        } catch (const std::invalid_argument &) {
+            thrown = true;
+        }
+        if (!thrown)
+            fail("duplicate keys in a static map");
+
+        std::pair<int, int> elements[100];
+        for (int i = 0; i < 100; ++i)
+            elements[i] = {i * 1024, i};
+        StaticHashMap<int, int, 100, 100, StaticHash, PowerOfTwoIndexer> numbers(elements);
+        for (int i = 0; i < 100; ++i) {
+            if (numbers.at(i * 1024) != i || numbers.find(i * 1024 + 1) != numbers.end())
+                fail("wrong static map built at run time");
+        }
+        if (numbers.slot_count() != 128)
+            fail("wrong static map slot count");
+        std::cerr << "ok!\n";
+    }
+
+    // collides every key until its first reseed, like keys an attacker picked for a known seed
+    struct FloodedHash {
+        std::uint64_t seed = 0;
+
+        std::size_t operator()(int x) const {
+            return seed == 0 ? 0 : static_cast<std::size_t>(seeded_hash_detail::hash_integer(x, seed));
+        }
+
+        void reseed() {
+            ++seed;
+        }
+    };
+
+    // collides every key under every seed
+    struct ConstantHash {
+        std::size_t operator()(int) const {
+            return 42;
+        }
+
+        void reseed() {}
+    };
+
+    template<class Map>
+    void check_reseed(Map &map) {
+        for (int i = 0; i < 3000; ++i)
+            map[i] = i;
+        if (map.stats().reseeds != 1 || map.hash_function().seed != 1)
+            fail("long chain doesn't reseed");
+        for (int i = 0; i < 3000; ++i) {
+            if (map.at(i) != i)
+                fail("wrong element after reseed");
+        }
+        if (map.chain_length_histogram().size() > 20)
+            fail("long chains after reseed");
+    }
+
+/* check that seeded hashes differ per seed and that flooded maps reseed and keep their elements */
+    void check_seeded_hash() {
+        std::cerr << "check seeded hash...\n";
+        ::SeededHash<std::string> first, second;
+        if (first.seed() == second.seed() || first("key") == second("key"))
+            fail("instances share seeds");
+        ::SeededHash<std::string> same(first.seed());
+        std::vector<std::size_t> hashes;
+        std::string text;
+        for (int i = 0; i < 40; ++i) {
+            if (same(text) != first(text))
+                fail("equal seeds hash differently");
+            hashes.push_back(first(text));
+            text += static_cast<char>('a' + i % 3);
+        }
+        std::sort(hashes.begin(), hashes.end());
+        if (std::adjacent_find(hashes.begin(), hashes.end()) != hashes.end())
+            fail("prefixes collide");
+        ::SeededHash<int> ints(7);
+        if (ints(1) == ints(2) || ints(1) != ::SeededHash<int>(7)(1) || ints(1) == ::SeededHash<int>(8)(1))
+            fail("wrong integer hash");
+        first.reseed();
+        if (first.seed() == same.seed())
+            fail("reseed keeps the seed");
+
+        using StatsAllocator = std::allocator<std::pair<const int, int>>;
+        HashMap<int, int, FloodedHash, InterleavedLayout, std::uint32_t, ModuloIndexer, NoStoredHash, StatsAllocator,
+                CountingStats> interleaved;
+        check_reseed(interleaved);
+        HashMap<int, int, FloodedHash, SplitLayout, std::uint32_t, FastRangeIndexer, StoredHash<std::uint32_t>,
+                StatsAllocator, CountingStats> split;
+        split.incremental_rehash(true);
+        check_reseed(split);
+
+        // a reseed in the middle of a batch rehashes the keys of the batch that wait for their insert
+        HashMap<int, int, FloodedHash, InterleavedLayout, std::uint32_t, ModuloIndexer, NoStoredHash, StatsAllocator,
+                CountingStats> batched;
+        std::vector<std::pair<int, int>> batch;
+        for (int i = 0; i < 200; ++i)
+            batch.emplace_back(i, i);
+        if (batched.insert_batch(batch.begin(), batch.end()) != 200 || batched.stats().reseeds != 1)
+            fail("batch doesn't reseed");
+        for (int i = 0; i < 200; ++i) {
+            if (batched.find(i) == batched.end() || batched.at(i) != i)
+                fail("batch insert across a reseed loses a key");
+        }
+
+        HashMap<int, int, ConstantHash, InterleavedLayout, std::uint32_t, ModuloIndexer, NoStoredHash, StatsAllocator,
+                CountingStats> constant;
+        for (int i = 0; i < 1000; ++i)
+            constant[i] = i;
+        if (constant.stats().reseeds > constant.stats().rehashes / 2 + 1 || constant.at(999) != 999)
+            fail("keys that always collide keep reseeding");
+        std::uint64_t reseeds = constant.stats().reseeds;
+        constant.reseed();
+        if (constant.stats().reseeds != reseeds + 1 || constant.size() != 1000 || constant.at(999) != 999)
+            fail("wrong explicit reseed");
+        std::cerr << "ok!\n";
+    }
+
+    template<class Map>
+    void check_parallel_rehash(InsertionMode mode) {
+        std::map<int, int> expected;
+        Map serial, parallel;
+        serial.insertion_mode(mode);
+        parallel.insertion_mode(mode);
+        parallel.rehash_threads(4);
+        std::uint64_t random = 3;
+        for (int i = 0; i < 150000; ++i) {
+            random = random * 6364136223846793005ULL + 1442695040888963407ULL;
+            int key = static_cast<int>(random >> 36);
+            expected[key] = i;
+            serial[key] = i;
+            parallel[key] = i;
+        }
+        for (int round = 0; round < 2; ++round) {
+            if (serial.slot_count() != parallel.slot_count() || parallel.size() != expected.size())
+                fail("wrong size after parallel rehash");
+            for (const auto &element : expected) {
+                auto it = parallel.find(element.first);
+                if (it == parallel.end() || it->second != element.second)
+                    fail("parallel rehash loses an element");
+            }
+            parallel.parallel_rehash(3 * parallel.slot_count(), 3);
+            serial.rehash(3 * serial.slot_count());
+        }
+        if (parallel.rehash_threads() != 4)
+            fail("parallel_rehash keeps its thread count");
+        for (const auto &element : expected) {
+            if (element.first % 3 == 0)
+                parallel.erase(element.first);
+        }
+        parallel.insert({-1, -1});
+        parallel.shrink_to_fit();
+        for (const auto &element : expected) {
+            if ((parallel.find(element.first) == parallel.end()) != (element.first % 3 == 0))
+                fail("wrong map after parallel shrink");
+        }
+        if (parallel.at(-1) != -1)
+            fail("wrong insert after parallel rehash");
+    }
+
+/* check that rehashing on several threads keeps every element, and that split ranges cover the map once */
+    void check_parallel_rehash() {
+        std::cerr << "check parallel rehash...\n";
+        check_parallel_rehash<HashMap<int, int>>(InsertionMode::LATE);
+        check_parallel_rehash<HashMap<int, int, std::hash<int>, SplitLayout, std::uint32_t, FastRangeIndexer,
+                StoredHash<>>>(InsertionMode::EARLY);
+        check_parallel_rehash<HashMap<int, int, CollidingHash, InterleavedLayout, std::uint32_t, PowerOfTwoIndexer>>(
+                InsertionMode::VARIED);
+        try {
+            HashMap<int, int>().rehash_threads(0);
+            fail("no exception for zero rehash threads");
+        } catch (const std::invalid_argument &) {
+        }
+
+        HashMap<int, int> map;
+        int n = 0;
+        for (; n < 5000; ++n)
+            map[n] = n;
+        map.incremental_rehash(true);
+        while (!map.rehashing())
+            map[n] = n, ++n;
+        for (std::size_t parts : {1, 2, 7, 1000}) {
+            std::vector<int> seen(n, 0);
+            auto ranges = map.split_ranges(parts);
+            if (ranges.size() != parts || ranges.front().first != map.begin() || ranges.back().second != map.end())
+                fail("split ranges don't span the map");
+            for (std::size_t k = 0; k < ranges.size(); ++k) {
+                if (k > 0 && ranges[k].first != ranges[k - 1].second)
+                    fail("split ranges aren't adjacent");
+                for (auto it = ranges[k].first; it != ranges[k].second; ++it)
+                    ++seen[it->first];
+            }
+            if (std::count(seen.begin(), seen.end(), 1) != n)
+                fail("split ranges don't visit every element once");
+        }
+        map.parallel_for_each([](std::pair<const int, int> &element) { element.second *= 2; }, 4);
+        std::atomic<long long> sum{0};
+        const HashMap<int, int> &const_map = map;
+        const_map.parallel_for_each([&](const std::pair<const int, int> &element) { sum += element.second; }, 3);
+        if (sum != static_cast<long long>(n) * (n - 1) || !map.rehashing())
+            fail("wrong parallel_for_each");
+        HashMap<int, int> empty;
+        if (empty.split_ranges(4).size() != 4 || empty.split_ranges(4)[2].first != empty.end())
+            fail("wrong split ranges of an empty map");
+        std::cerr << "ok!\n";
+    }
+
+    struct MoveOnlyKey {
+        std::unique_ptr<int> id;
+
+        explicit MoveOnlyKey(int id) : id(new int(id)) {}
+
+        bool operator==(const MoveOnlyKey &other) const {
+            return *id == *other.id;
+        }
+    };
+
+    struct MoveOnlyKeyHash {
+        std::size_t operator()(const MoveOnlyKey &key) const {
+            return static_cast<std::size_t>(*key.id / 4);
+        }
+    };
+
+    template<class Map>
+    void check_node_handle() {
+        Map map, other;
+        map.max_load_factor(0.9f);
+        for (int i = 0; i < 3000; ++i)
+            map.try_emplace(MoveOnlyKey(i), new int(i));
+        typename Map::node_type missing = map.extract(MoveOnlyKey(-1));
+        if (missing || !missing.empty() || map.size() != 3000)
+            fail("extract of a missing key isn't empty");
+        typename Map::node_type node = map.extract(MoveOnlyKey(17));
+        if (node.empty() || *node.key().id != 17 || *node.mapped() != 17 || map.size() != 2999 ||
+            map.find(MoveOnlyKey(17)) != map.end())
+            fail("wrong extract");
+        const int *value = node.mapped().get();
+        *node.key().id = 5000;
+        auto result = other.insert(std::move(node));
+        if (!result.inserted || !node.empty() || !result.node.empty() || result.position->second.get() != value ||
+            other.size() != 1)
+            fail("wrong insert of a node");
+        node = other.extract(MoveOnlyKey(5000));
+        *node.key().id = 3;
+        result = map.insert(std::move(node));
+        if (result.inserted || result.node.empty() || result.node.mapped().get() != value ||
+            *result.position->second != 3 || !other.empty())
+            fail("insert of a node with a present key loses it");
+        if (map.insert(typename Map::node_type()).inserted)
+            fail("empty node inserted");
+
+        // other gets keys 2000 to 3999, of which 2000 to 2998 are in both maps
+        for (int i = 2000; i < 4000; ++i)
+            other.try_emplace(MoveOnlyKey(i), new int(-i));
+        other.incremental_rehash(true);
+        other.rehash(3 * other.slot_count());
+        map.merge(other);
+        if (map.size() != 4000 - 1 || other.size() != 1000)
+            fail("wrong sizes after merge");
+        for (int i = 0; i < 4000; ++i) {
+            if (i == 17)
+                continue;
+            int expected = i < 3000 ? i : -i;
+            if (*map.at(MoveOnlyKey(i)) != expected)
+                fail("wrong element after merge");
+            if ((other.find(MoveOnlyKey(i)) != other.end()) != (i >= 2000 && i < 3000))
+                fail("merge moves a duplicate or leaves an element");
+        }
+        map.merge(std::move(other));
+        map.merge(map);
+        if (map.size() != 3999 || other.size() != 1000)
+            fail("merge of duplicates changes the maps");
+    }
+
+/* check that extract, insert of nodes and merge move elements between maps without copying them */
+    void check_node_handle() {
+        std::cerr << "check node handle...\n";
+        check_node_handle<HashMap<MoveOnlyKey, std::unique_ptr<int>, MoveOnlyKeyHash>>();
+        check_node_handle<HashMap<MoveOnlyKey, std::unique_ptr<int>, MoveOnlyKeyHash, SplitLayout, std::uint32_t,
+                FastRangeIndexer, StoredHash<>>>();
+
+        ShardedHashMap<int, std::string, std::hash<int>, 4> first, second;
+        first.insert({1, std::string(100, 'x')});
+        auto node = first.extract(1);
+        if (!second.insert(std::move(node)) || first.contains(1) || !second.contains(1))
+            fail("wrong move between sharded maps");
+        second.insert({2, "b"});
+        node = second.extract(1);
+        node.key() = 2;
+        if (second.insert(std::move(node)) || node.empty() || node.mapped() != std::string(100, 'x'))
+            fail("sharded insert of a node with a present key loses it");
+        std::cerr << "ok!\n";
+    }
+
+/* check lookups of keys compared as single words, including misses at the end of long chains */
+    void check_word_keys() {
+        std::cerr << "check word keys...\n";
+        enum class Color : std::uint8_t {
+        };
+        struct ColorHash {
+            std::size_t operator()(Color color) const {
+                return static_cast<std::size_t>(color) / 16;
+            }
+        };
+        HashMap<Color, int, ColorHash, SplitLayout, std::uint32_t, ModuloIndexer, StoredHash<>> colors;
+        for (int i = 0; i < 200; i += 2)
+            colors[static_cast<Color>(i)] = i;
+        for (int i = 0; i < 256; ++i) {
+            auto it = colors.find(static_cast<Color>(i));
+            if ((it != colors.end()) != (i < 200 && i % 2 == 0) || (it != colors.end() && it->second != i))
+                fail("wrong lookup of an enum key");
+        }
+
+        std::vector<int> targets(1000);
+        HashMap<const int *, std::size_t> pointers;
+        for (std::size_t i = 0; i < targets.size(); i += 3)
+            pointers.insert({&targets[i], i});
+        for (std::size_t i = 0; i < targets.size(); ++i) {
+            auto it = pointers.find(&targets[i]);
+            if ((it != pointers.end()) != (i % 3 == 0) || (it != pointers.end() && it->second != i))
+                fail("wrong lookup of a pointer key");
+        }
+        std::cerr << "ok!\n";
+    }
+
+    struct FakeClock {
+        using duration = std::chrono::seconds;
+        using rep = duration::rep;
+        using period = duration::period;
+        using time_point = std::chrono::time_point<FakeClock>;
+        static constexpr bool is_steady = true;
+        static time_point current;
+
+        static time_point now() {
+            return current;
+        }
+    };
+
+    FakeClock::time_point FakeClock::current;
+
+/* check eviction order, chains relinked by evictions and the time to live of the LRU cache */
+    void check_lru_cache() {
+        std::cerr << "check lru cache...\n";
+        LruCache<int, std::string> cache(3);
+        cache.try_emplace(1, "one");
+        cache.try_emplace(2, "two");
+        cache.insert_or_assign(3, std::string("three"));
+        if (!cache.find(1) || *cache.find(1) != "one" || cache.try_emplace(3, "x").second)
+            fail("wrong cache lookup");
+        cache.try_emplace(4, "four");
+        std::vector<int> order;
+        cache.for_each([&](int key, const std::string &) { order.push_back(key); });
+        if (cache.size() != 3 || cache.contains(2) || cache.evictions() != 1 || order != std::vector<int>{4, 3, 1})
+            fail("wrong eviction");
+        if (!cache.erase(3) || cache.erase(3) || cache.size() != 2)
+            fail("wrong cache erase");
+        cache.clear();
+        if (!cache.empty() || cache.peek(1) || !cache.try_emplace(1, "again").second)
+            fail("wrong cache clear");
+
+        // colliding keys make every eviction move elements up their chains
+        LruCache<int, int, CollidingHash> colliding(100);
+        std::vector<int> recency;
+        std::uint64_t random = 5;
+        for (int step = 0; step < 20000; ++step) {
+            random = random * 6364136223846793005ULL + 1442695040888963407ULL;
+            int key = static_cast<int>(random >> 33) % 300;
+            auto it = std::find(recency.begin(), recency.end(), key);
+            if (random >> 63) {
+                int *value = colliding.find(key);
+                if ((value != nullptr) != (it != recency.end()) || (value && *value != key))
+                    fail("cache lookup disagrees with the reference");
+                if (it != recency.end()) {
+                    recency.erase(it);
+                    recency.insert(recency.begin(), key);
+                }
+            } else if (it == recency.end()) {
+                colliding.try_emplace(key, key);
+                if (recency.size() == colliding.capacity())
+                    recency.pop_back();
+                recency.insert(recency.begin(), key);
+            } else {
+                colliding.erase(key);
+                recency.erase(it);
+            }
+            if (step % 1000 == 0) {
+                order.clear();
+                colliding.for_each([&](int key, int) { order.push_back(key); });
+                if (order != recency)
+                    fail("wrong recency order");
+            }
+        }
+        if (colliding.size() != recency.size())
+            fail("wrong cache size");
+
+        LruCache<int, int, std::hash<int>, std::uint16_t, PowerOfTwoIndexer, FakeClock> timed(10,
+                                                                                              std::chrono::seconds(5));
+        timed.try_emplace(1, 1);
+        FakeClock::current += std::chrono::seconds(3);
+        timed.try_emplace(2, 2);
+        timed.find(1);
+        FakeClock::current += std::chrono::seconds(3);
+        if (timed.peek(1) || !timed.peek(2) || timed.size() != 2)
+            fail("wrong expiry");
+        if (timed.find(1) || timed.size() != 1 || !timed.try_emplace(1, 10).second || *timed.find(1) != 10)
+            fail("expired element not replaced");
+        timed.insert_or_assign(2, 20);
+        FakeClock::current += std::chrono::seconds(4);
+        if (!timed.contains(2) || timed.contains(3))
+            fail("insert_or_assign doesn't renew the time to live");
+        try {
+            LruCache<int, int> empty(0);
+            fail("no exception for zero capacity");
+        } catch (const std::invalid_argument &) {
+        }
+        std::cerr << "ok!\n";
+    }
+
+    struct Counted {
+        static int copies;
+        int value = 0;
+
+        Counted(int value) : value(value) {}
+
+        Counted(const Counted &other) : value(other.value) {
+            ++copies;
+        }
+    };
+
+    int Counted::copies = 0;
+
+/* check that snapshots of paged maps keep their contents while the map is written, rehashed and cleared */
+    void check_cow_snapshot() {
+        std::cerr << "check copy-on-write snapshot...\n";
+        HashMap<int, std::string, std::hash<int>, PagedLayout<64>> map;
+        std::map<int, std::string> expected;
+        for (int i = 0; i < 1000; ++i) {
+            map.insert({i, "value " + std::to_string(i)});
+            expected[i] = "value " + std::to_string(i);
+        }
+        auto snapshot = map.snapshot();
+        auto check = [&](const auto &snapshot, const std::map<int, std::string> &expected) {
+            std::size_t count = 0;
+            for (const auto &element : snapshot) {
+                auto it = expected.find(element.first);
+                if (it == expected.end() || it->second != element.second)
+                    fail("snapshot changed");
+                ++count;
+            }
+            if (count != expected.size() || snapshot.size() != expected.size())
+                fail("wrong snapshot size");
+            for (int i = -10; i < 3000; ++i) {
+                auto it = snapshot.find(i);
+                if ((it != snapshot.end()) != (expected.count(i) != 0) ||
+                    (it != snapshot.end() && (*it).second != expected.at(i)))
+                    fail("wrong snapshot lookup");
+            }
+        };
+
+        std::map<int, std::string> written = expected;
+        std::thread reader([&] { check(snapshot, expected); });
+        for (int i = 0; i < 1000; i += 2) {
+            map.erase(i);
+            written.erase(i);
+        }
+        map[1] = "changed";
+        written[1] = "changed";
+        for (int i = 1000; i < 3000; ++i) {
+            map.insert({i, std::to_string(i)});
+            written[i] = std::to_string(i);
+        }
+        reader.join();
+        check(snapshot, expected);
+        check(map.snapshot(), written);
+        if (snapshot.at(1) != "value 1" || map.at(1) != "changed")
+            fail("write reached the snapshot");
+
+        map.parallel_for_each([](auto &&element) { element.second += "!"; }, 2);
+        check(snapshot, expected);
+        if (map.at(1) != "changed!")
+            fail("wrong parallel_for_each on shared pages");
+
+        std::stringstream stream;
+        snapshot.serialize(stream);
+        HashMap<int, std::string> copy;
+        copy.deserialize(stream);
+        if (copy.size() != expected.size() || copy.at(999) != expected.at(999))
+            fail("wrong snapshot serialization");
+
+        HashMap<int, std::string, std::hash<int>, PagedLayout<64>> shared(map);
+        shared.clear();
+        map.clear();
+        check(snapshot, expected);
+        if (!map.empty() || map.find(1) != map.end())
+            fail("wrong clear of shared pages");
+
+        // taking a snapshot copies no element, the first write to a page copies that page only
+        Counted::copies = 0;
+        HashMap<int, Counted, std::hash<int>, PagedLayout<64>> counted(4096);
+        for (int i = 0; i < 2000; ++i)
+            counted.emplace(i, i);
+        int copies = Counted::copies;
+        auto counted_snapshot = counted.snapshot();
+        if (Counted::copies != copies)
+            fail("snapshot copies elements");
+        counted.find(7)->second.value = -1;
+        if (Counted::copies == copies || Counted::copies - copies > 64 || counted_snapshot.at(7).value != 7)
+            fail("write copies more than its page");
+
+        // a rehash under a snapshot copies each element once into the new table, without cloning the old pages
+        copies = Counted::copies;
+        counted.rehash(16384);
+        if (Counted::copies - copies > 2000 || counted_snapshot.size() != 2000 || counted_snapshot.at(7).value != 7)
+            fail("rehash under a snapshot clones pages");
+        for (int i = 0; i < 2000; ++i)
+            if (counted.find(i) == counted.end() || counted_snapshot.at(i).value != i)
+                fail("wrong rehash under a snapshot");
+        counted.erase(3);
+        if (counted_snapshot.at(3).value != 3 || counted.find(3) != counted.end())
+            fail("erase reached the snapshot");
+
+        // a snapshot in the middle of an incremental rehash keeps both tables
+        HashMap<int, std::string, std::hash<int>, PagedLayout<64>, std::uint32_t, PowerOfTwoIndexer,
+                StoredHash<>> incremental;
+        incremental.incremental_rehash(true);
+        std::map<int, std::string> before;
+        for (int i = 0; !incremental.rehashing() || i < 600; ++i) {
+            incremental.insert({i * 7, std::to_string(i)});
+            before[i * 7] = std::to_string(i);
+        }
+        auto migrating = incremental.snapshot();
+        for (int i = 0; i < 4000; ++i) {
+            incremental.erase(i * 7);
+            incremental.insert({i * 7 + 1, "new"});
+        }
+        check(migrating, before);
+        std::cerr << "ok!\n";
+    }
+
     void run_all() {
         const_check();
         exception_check();
@@ -265,6 +2047,35 @@ namespace internal_tests {
         check_destructor();
         check_copy();
         check_iterators();
+        check_incremental_rehash();
+        check_capacity();
+        check_split_layout();
+        check_index_type();
+        check_cellar();
+        check_indexers();
+        check_stored_hash();
+        check_heterogeneous_lookup();
+        check_emplace();
+        check_move();
+        check_slot_storage();
+        check_allocator();
+        check_slot_bitmap();
+        check_free_slots();
+        check_concurrent();
+        check_sharded();
+        check_batch();
+        check_build();
+        check_snapshot();
+        check_serialization();
+        check_stats();
+        check_small_map();
+        check_static_map();
+        check_seeded_hash();
+        check_parallel_rehash();
+        check_node_handle();
+        check_word_keys();
+        check_lru_cache();
+        check_cow_snapshot();
     }
 } // namespace internal_tests
 